@@ -0,0 +1,127 @@
+/**
+ * @brief Implementation of AccountList
+ *
+ * @file accountlist.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "accountlist.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <stdlib.h>
+
+namespace
+{
+    bool isPrivate(std::string const& path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && (info.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+    }
+
+    bool isIndirect(std::string const& password)
+    {
+        return password.compare(0, 4, "env:") == 0 || password.compare(0, 5, "file:") == 0;
+    }
+}
+
+AccountList::AccountList(std::string const& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        throw AccountsError("Unable to open accounts file", path);
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    bool hasPasswords = false;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+
+        std::stringstream fields(line);
+        std::string hostname;
+        if (!(fields >> hostname) || hostname[0] == '#')
+        {
+            continue;
+        }
+
+        Account account;
+        account.hostname = hostname;
+
+        std::string port;
+        std::string password;
+        std::stringstream location;
+        location << path << ":" << lineNumber;
+
+        if (!(fields >> port >> account.username >> password >> account.directory))
+        {
+            throw AccountsError("Incomplete account (hostname port username password directory)",
+                                location.str());
+        }
+
+        account.port = atoi(port.c_str());
+        if (account.port < 1 || account.port > 65535)
+        {
+            throw AccountsError("Port out of range (1 ~ 65535)", location.str());
+        }
+
+        account.password = getPassword(password, location.str());
+        hasPasswords = hasPasswords || !isIndirect(password);
+
+        accounts.push_back(account);
+    }
+
+    if (accounts.empty())
+    {
+        throw AccountsError("No accounts found", path);
+    }
+
+    if (hasPasswords && !isPrivate(path))
+    {
+        throw AccountsError("Accounts file is accessible by other users", path);
+    }
+}
+
+std::string AccountList::getPassword(std::string const& field, std::string const& location)
+{
+    if (field.compare(0, 4, "env:") == 0)
+    {
+        const char* value = getenv(field.c_str() + 4);
+        if (value == NULL)
+        {
+            throw AccountsError("Password variable is not set", location + " " + field.substr(4));
+        }
+        return value;
+    }
+
+    if (field.compare(0, 5, "file:") == 0)
+    {
+        std::string path = field.substr(5);
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            throw AccountsError("Unable to open password file", location + " " + path);
+        }
+
+        if (!isPrivate(path))
+        {
+            throw AccountsError("Password file is accessible by other users", location + " " + path);
+        }
+
+        std::string password;
+        std::getline(file, password);
+        if (!password.empty() && password[password.length() - 1] == '\r')
+        {
+            password.erase(password.length() - 1);
+        }
+        return password;
+    }
+
+    return field;
+}
@@ -0,0 +1,82 @@
+/**
+ * @brief Accounts polled by the daemon
+ *
+ * @file accountlist.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _ACCOUNTLIST__H
+#define _ACCOUNTLIST__H
+
+#include <string>
+#include <vector>
+
+#include "error.h"
+
+/**
+ * @brief Mailbox on a POP3 server.
+ */
+struct Account
+{
+    std::string hostname;
+    int port;
+    std::string username;
+    std::string password;
+    std::string directory; /*< Where the messages are saved */
+
+    std::string getName() const { return username + "@" + hostname; }
+};
+
+/**
+ * @brief List of accounts loaded from a file.
+ *
+ *  Each line of the file describes one account:
+ *
+ *    hostname port username password directory
+ *
+ *  Fields are separated by white space. Empty lines and lines
+ *  starting with '#' are ignored. The password may be given
+ *  indirectly:
+ *
+ *    env:NAME   the value of the environment variable NAME
+ *    file:PATH  the first line of the file PATH
+ *
+ *  A file that holds passwords (the accounts file with a password
+ *  in it, or a password file) is refused when other users can
+ *  access it.
+ */
+class AccountList
+{
+    std::vector<Account> accounts;
+
+    public:
+        /**
+         * @param[in] path Path to the accounts file.
+         */
+        AccountList(std::string const& path);
+
+        size_t size() const { return accounts.size(); }
+        Account const& operator[](size_t index) const { return accounts[index]; }
+
+        /* Exceptions */
+        class AccountsError;
+
+    private:
+        static std::string getPassword(std::string const& field, std::string const& location);
+};
+
+/**
+ * @brief Indicates unusable accounts file.
+ */
+class AccountList::AccountsError : public Error
+{
+    public:
+        AccountsError(std::string const& issue, std::string const& detail)
+        {
+            problem = issue;
+            reason  = detail;
+        }
+};
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * @brief Implementation of BatchRunner
+ *
+ * @file batchrunner.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "batchrunner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <time.h>
+
+#include "error.h"
+#include "journal.h"
+#include "messagedirectory.h"
+#include "pop3session.h"
+#include "searchindex.h"
+
+BatchRunner::BatchRunner(AccountList const& accounts, CliArguments const& options)
+    : arguments(options), profiles(options.getProfileCache()), workerCount(options.getBatchWorkers()),
+      hostLimit(options.getHostConnections()), batchTime(0)
+{
+    if (options.isFilterSet())
+    {
+        rules.reset(new FilterRules(options.getFilterFile()));
+    }
+
+    for (size_t i = 0; i < accounts.size(); i++)
+    {
+        Result result;
+        result.account = accounts[i];
+        result.isDone  = false;
+        result.time    = 0;
+
+        results.push_back(result);
+        pending.push_back(i);
+    }
+}
+
+void BatchRunner::run()
+{
+    uint64_t start = getTime();
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(workerCount, results.size()); i++)
+    {
+        workers.push_back(std::thread(&BatchRunner::work, this));
+    }
+
+    for (std::vector<std::thread>::iterator worker = workers.begin(); worker != workers.end(); worker++)
+    {
+        worker->join();
+    }
+
+    batchTime = getTime() - start;
+
+    try
+    {
+        profiles.save();
+    }
+    catch (std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+    }
+}
+
+void BatchRunner::work()
+{
+    size_t index;
+    while (takeAccount(&index))
+    {
+        fetch(&results[index]);
+        releaseAccount(index);
+    }
+}
+
+bool BatchRunner::takeAccount(size_t* index)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!pending.empty())
+    {
+        for (std::vector<size_t>::iterator next = pending.begin(); next != pending.end(); next++)
+        {
+            unsigned& open = sessions[getHost(results[*next].account)];
+            if (open < hostLimit)
+            {
+                open++;
+                *index = *next;
+                pending.erase(next);
+                return true;
+            }
+        }
+
+        /* All the remaining accounts are on busy hosts. */
+        hostReleased.wait(lock);
+    }
+
+    return false;
+}
+
+void BatchRunner::releaseAccount(size_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions[getHost(results[index].account)]--;
+    }
+    hostReleased.notify_all();
+}
+
+void BatchRunner::fetch(Result* result)
+{
+    Account const& account = result->account;
+
+    ServerProfile profile;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        profile = profiles.get(account.hostname, account.port);
+    }
+
+    uint64_t start = getTime();
+    try
+    {
+        Pop3Session pop3(account.hostname, account.port, &profile);
+        pop3.authenticate(account.username, account.password);
+
+        FetchPlanner::Limits limits;
+        limits.maxMessageSize = arguments.getMaxMessageSize();
+        limits.byteBudget     = arguments.getByteBudget();
+
+        MessageDirectory directory(account.directory);
+        Journal journal(account.directory + "/journal");
+
+        Fetcher fetcher(&pop3, limits);
+        fetcher.setDeleteCommitted(arguments.isDeleteSet());
+        fetcher.setFilter(rules.get());
+        fetcher.setTranscoding(arguments.isTranscodeSet());
+
+        std::unique_ptr<SearchIndex> index;
+        if (arguments.isIndexSet())
+        {
+            index.reset(new SearchIndex(account.directory + "/index"));
+            fetcher.setIndex(index.get());
+        }
+
+        fetcher.fetchMissing(&directory, &journal);
+
+        result->report = fetcher.getReport();
+        result->isDone = true;
+    }
+    catch (std::exception& error)
+    {
+        /* Not only Error: anything that escaped the thread
+           would end the whole batch. */
+        result->error = error.what();
+    }
+    result->time = getTime() - start;
+
+    std::stringstream message;
+    if (result->isDone)
+    {
+        message << "Saved " << result->report.retrieved << " message(s)";
+        if (arguments.isDeleteSet())
+        {
+            message << ", deleted " << result->report.deleted;
+        }
+    }
+    else
+    {
+        message << result->error;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* Whatever was learned is true even when the session failed. */
+    profiles.set(account.hostname, account.port, profile);
+    log(account, message.str());
+}
+
+void BatchRunner::printReport(std::ostream& output) const
+{
+    size_t nameWidth = 7;
+    for (std::vector<Result>::const_iterator result = results.begin(); result != results.end(); result++)
+    {
+        nameWidth = std::max(nameWidth, result->account.getName().length());
+    }
+
+    std::ios::fmtflags flags = output.flags();
+    std::streamsize precision = output.precision();
+    output << std::fixed << std::setprecision(1);
+
+    output << std::left << std::setw(nameWidth) << "Account" << std::right
+           << std::setw(10) << "Messages" << std::setw(14) << "Bytes"
+           << std::setw(10) << "Seconds" << std::setw(12) << "KB/s" << "  Status" << std::endl;
+
+    size_t messages = 0;
+    uint64_t bytes = 0;
+    for (std::vector<Result>::const_iterator result = results.begin(); result != results.end(); result++)
+    {
+        double seconds = result->time / 1e6;
+
+        output << std::left << std::setw(nameWidth) << result->account.getName() << std::right
+               << std::setw(10) << result->report.retrieved << std::setw(14) << result->report.bytes
+               << std::setw(10) << seconds << std::setw(12);
+        if (seconds > 0)
+        {
+            output << result->report.bytes / 1024.0 / seconds;
+        }
+        else
+        {
+            output << "-";
+        }
+        output << "  " << (result->isDone ? "ok" : result->error) << std::endl;
+
+        messages += result->report.retrieved;
+        bytes    += result->report.bytes;
+    }
+
+    double seconds = batchTime / 1e6;
+    output << results.size() << " account(s), " << getFailedCount() << " failed: "
+           << messages << " message(s), " << bytes << " bytes in " << seconds << " s";
+    if (seconds > 0)
+    {
+        output << " (" << bytes / 1024.0 / seconds << " KB/s)";
+    }
+    output << "." << std::endl;
+
+    output.flags(flags);
+    output.precision(precision);
+}
+
+size_t BatchRunner::getFailedCount() const
+{
+    size_t failed = 0;
+    for (std::vector<Result>::const_iterator result = results.begin(); result != results.end(); result++)
+    {
+        if (!result->isDone)
+        {
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+void BatchRunner::log(Account const& account, std::string const& message)
+{
+    char timestamp[32];
+    time_t now = time(NULL);
+    struct tm local;
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &local));
+
+    std::cout << timestamp << " " << account.getName() << ": " << message << std::endl;
+}
+
+std::string BatchRunner::getHost(Account const& account)
+{
+    std::string host = account.hostname;
+    std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+
+    return host;
+}
+
+uint64_t BatchRunner::getTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
@@ -0,0 +1,111 @@
+/**
+ * @brief Downloading many accounts at once
+ *
+ * @file batchrunner.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _BATCHRUNNER__H
+#define _BATCHRUNNER__H
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "accountlist.h"
+#include "cliarguments.h"
+#include "fetcher.h"
+#include "filterrules.h"
+#include "serverprofile.h"
+
+/**
+ * @brief Downloads the accounts from an AccountList once.
+ *
+ *  A pool of worker threads takes the accounts in the order of the
+ *  list. Each account is fetched into its directory with a journal,
+ *  the same way as -d does, so an interrupted batch resumes where it
+ *  stopped.
+ *
+ *  Servers limit the connections of a client, and some of them lock
+ *  out those that open too many. A worker therefore skips the
+ *  accounts of hosts that already have the maximal number of
+ *  sessions, and waits when all the remaining ones are like that.
+ *  The workers share the server profiles; the cache is saved once
+ *  the batch is done.
+ */
+class BatchRunner
+{
+    public:
+        struct Result
+        {
+            Account account;
+            bool isDone;         /*< Fetched without an error */
+            std::string error;
+            Fetcher::Report report;
+            uint64_t time;       /*< Microseconds from connecting to the end */
+        };
+
+    private:
+        std::vector<Result> results;
+        CliArguments const& arguments;
+        ProfileCache profiles;
+        std::unique_ptr<FilterRules> rules;
+        unsigned workerCount;
+        unsigned hostLimit;
+        uint64_t batchTime;                       /*< Microseconds */
+
+        /* Guards the members below, the profiles and the log. */
+        std::mutex mutex;
+        std::condition_variable hostReleased;
+        std::vector<size_t> pending;              /*< Indices into results */
+        std::map<std::string, unsigned> sessions; /*< Open sessions by host */
+
+    public:
+        /**
+         * @param[in] accounts Accounts to download.
+         * @param[in] options Worker count, host limit, and the options
+         *                    for fetching.
+         */
+        BatchRunner(AccountList const& accounts, CliArguments const& options);
+
+        /**
+         * @brief Download all the accounts.
+         *
+         *  Returns when every account was fetched or failed. The
+         *  outcome of each is logged as soon as it is known.
+         *
+         * @return void
+         */
+        void run();
+
+        /**
+         * @brief Print a table of the accounts with their messages,
+         *        data, time and throughput, and the totals.
+         *
+         * @param[out] output Where to print it.
+         * @return void
+         */
+        void printReport(std::ostream& output) const;
+
+        std::vector<Result> const& getResults() const { return results; }
+        size_t getFailedCount() const;
+
+    private:
+        void work();
+        bool takeAccount(size_t* index);
+        void releaseAccount(size_t index);
+        void fetch(Result* result);
+        void log(Account const& account, std::string const& message);
+
+        static std::string getHost(Account const& account);
+        static uint64_t getTime();
+};
+
+#endif
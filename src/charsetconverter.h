@@ -0,0 +1,98 @@
+/**
+ * @brief Conversion of text to UTF-8
+ *
+ * @file charsetconverter.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _CHARSETCONVERTER__H
+#define _CHARSETCONVERTER__H
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Converts text in a legacy charset to UTF-8.
+ *
+ *  The single-byte charsets of mail (ISO-8859-x, Windows-125x,
+ *  KOI8-R and KOI8-U) are supported. The charset names follow
+ *  the WHATWG Encoding Standard, so e.g. ISO-8859-1 is decoded
+ *  as Windows-1252, which is what the senders really mean.
+ *
+ *  Text declared as UTF-8 is validated instead: each malformed
+ *  sequence is replaced by U+FFFD, as are the bytes a charset
+ *  doesn't define.
+ *
+ *  Most mail is mostly ASCII, so runs of ASCII bytes are found
+ *  16 bytes at a time (SSE2) and copied as they are. Each other
+ *  byte is a single lookup in a table of ready-made UTF-8
+ *  sequences, built when the charset is chosen.
+ *
+ *  The input may be split anywhere; a UTF-8 sequence cut by the
+ *  end of a chunk is completed by the next one.
+ */
+class CharsetConverter
+{
+    /* UTF-8 of a byte >= 0x80, stored with a single 4-byte copy. */
+    struct Sequence
+    {
+        char bytes[3];
+        uint8_t length;
+    };
+
+    Sequence sequences[128];
+    bool isValidating;
+
+    /* Incomplete UTF-8 sequence from the last chunk */
+    char pending[4];
+    size_t pendingLength;
+    size_t missing;               /*< Continuation bytes still missing */
+    unsigned char lowest;         /*< Range of the next continuation byte */
+    unsigned char highest;
+
+    public:
+        CharsetConverter();
+
+        /**
+         * @brief Choose the charset of the input.
+         *
+         * @param[in] charset Name of the charset (e.g. from MIME),
+         *                    case doesn't matter.
+         * @return False when the charset isn't supported.
+         */
+        bool setCharset(std::string_view charset);
+
+        /* True for the names of UTF-8, the output needs no conversion. */
+        static bool isUtf8(std::string_view charset);
+
+        /* True for the names of US-ASCII. */
+        static bool isAscii(std::string_view charset);
+
+        /**
+         * @brief Convert the next chunk of the text.
+         *
+         * @param[in] data The text.
+         * @param[in] length Number of bytes in \c data.
+         * @param[out] output The UTF-8 is appended here.
+         * @return void
+         */
+        void convert(const char* data, size_t length, std::string* output);
+
+        /**
+         * @brief End the text, e.g. at the end of a MIME part.
+         *
+         * @param[out] output Where to append the rest.
+         * @return void
+         */
+        void finish(std::string* output);
+
+    private:
+        void decode(const char* data, size_t length, std::string* output);
+        void validate(const char* data, size_t length, std::string* output);
+
+        static std::string normalize(std::string_view charset);
+};
+
+#endif
@@ -7,9 +7,14 @@
  */
 
 #include "cliarguments.h"
+#include "serverprofile.h"
 
 #include <string>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -25,8 +30,28 @@ void CliArguments::parse(int argc, char **argv)
     hostname = "";
     username = "";
     messageId = 0;
+    storeDirectory = "";
+    outputDirectory = "";
+    maxMessageSize = 0;
+    byteBudget = 0;
+    raw = false;
+    deleteMessages = false;
+    ioBackend = SocketBackend::CLASSIC;
+    socketOptions = Socket::Options();
+    accountsFile = "";
+    indexMessages = false;
+    query = "";
+    verify = false;
+    profileCache = ProfileCache::getDefaultPath();
+    filterFile = "";
+    transcode = false;
+    archiveDirectory = "";
+    extractDigest = "";
+    pollInterval = __POLL_INTERVAL;
+    batchWorkers = 0;
+    hostConnections = __HOST_CONNECTIONS;
 
-    while ((option = getopt (argc, argv, "h:p:u:")) != -1)
+    while ((option = getopt (argc, argv, "h:p:u:s:d:Dm:b:ri:O:a:t:xq:VC:F:Uz:e:j:H:")) != -1)
     {
       switch (option)
       {
@@ -39,6 +64,66 @@ void CliArguments::parse(int argc, char **argv)
         case 'u': /* Username */
           setUsername(optarg);
           break;
+        case 's': /* Message store */
+          setStoreDirectory(optarg);
+          break;
+        case 'd': /* Output directory */
+          setOutputDirectory(optarg);
+          break;
+        case 'D': /* Delete after download */
+          deleteMessages = true;
+          break;
+        case 'm': /* Message size limit */
+          maxMessageSize = convertStringToSize("-m", optarg);
+          break;
+        case 'b': /* Byte budget */
+          byteBudget = convertStringToSize("-b", optarg);
+          break;
+        case 'r': /* Raw message output */
+          raw = true;
+          break;
+        case 'i': /* I/O backend */
+          setIoBackend(optarg);
+          break;
+        case 'O': /* TCP options */
+          setSocketOptions(optarg);
+          break;
+        case 'a': /* Daemon mode */
+          accountsFile = std::string(optarg);
+          break;
+        case 't': /* Daemon poll interval */
+          setPollInterval(optarg);
+          break;
+        case 'x': /* Index saved messages */
+          indexMessages = true;
+          break;
+        case 'q': /* Search the index */
+          query = std::string(optarg);
+          break;
+        case 'V': /* Verify saved messages */
+          verify = true;
+          break;
+        case 'C': /* Server profile cache, empty turns it off */
+          profileCache = std::string(optarg);
+          break;
+        case 'F': /* Filter rules */
+          filterFile = std::string(optarg);
+          break;
+        case 'U': /* Convert text to UTF-8 */
+          transcode = true;
+          break;
+        case 'z': /* Compressed archive */
+          archiveDirectory = std::string(optarg);
+          break;
+        case 'e': /* Extract from the archive */
+          extractDigest = std::string(optarg);
+          break;
+        case 'j': /* Batch mode workers */
+          setBatchWorkers(optarg);
+          break;
+        case 'H': /* Batch mode sessions per host */
+          setHostConnections(optarg);
+          break;
         case '?':
           throw GetoptError();
           break;
@@ -56,6 +141,63 @@ void CliArguments::parse(int argc, char **argv)
 
 void CliArguments::checkMandatoryArguments() const
 {
+    /* Messages go to one place only. */
+    if (isStoreDirectorySet() && isOutputDirectorySet())
+    {
+        throw ConflictingArgumentsError("-s", "-d");
+    }
+    if (isStoreDirectorySet() && isArchiveSet())
+    {
+        throw ConflictingArgumentsError("-s", "-z");
+    }
+    if (isOutputDirectorySet() && isArchiveSet())
+    {
+        throw ConflictingArgumentsError("-d", "-z");
+    }
+
+    /* The daemon reads the accounts from a file. */
+    if (isDaemonSet())
+    {
+        return;
+    }
+
+    /* So does the batch mode. */
+    if (isBatchSet())
+    {
+        throw MissingArgumentError("-a");
+    }
+
+    /* Searching and verification work offline. */
+    if (isQuerySet() || isVerifySet())
+    {
+        if (!isOutputDirectorySet())
+        {
+            throw MissingArgumentError("-d");
+        }
+        return;
+    }
+
+    /* So does extraction. */
+    if (isExtractSet())
+    {
+        if (!isArchiveSet())
+        {
+            throw MissingArgumentError("-z");
+        }
+        return;
+    }
+
+    if (indexMessages && !isOutputDirectorySet())
+    {
+        throw MissingArgumentError("-d");
+    }
+
+    /* Only the messages that were saved are deleted. */
+    if (isDeleteSet() && !isStoreDirectorySet() && !isOutputDirectorySet() && !isArchiveSet())
+    {
+        throw MissingArgumentError("-d");
+    }
+
     if (hostname.length() <= 0)
     {
         throw MissingArgumentError("-h");
@@ -72,6 +214,38 @@ int CliArguments::convertStringToInteger(std::string numberStoredInString)
   return static_cast<int>(atoi(numberStoredInString.c_str()));
 }
 
+size_t CliArguments::convertStringToSize(std::string const& option, std::string sizeStoredInString)
+{
+    char* suffix;
+    errno = 0;
+    unsigned long long size = strtoull(sizeStoredInString.c_str(), &suffix, 10);
+    unsigned long long multiplier = 1;
+
+    switch (*suffix)
+    {
+        case 'G': multiplier *= 1024;
+                  /* fall through */
+        case 'M': multiplier *= 1024;
+                  /* fall through */
+        case 'K': multiplier *= 1024;
+                  suffix++;
+                  break;
+    }
+
+    /* strtoull() takes a sign, and wraps negative numbers around. */
+    if (!isdigit(static_cast<unsigned char>(sizeStoredInString[0])) || *suffix != '\0' || size == 0)
+    {
+        throw ArgumentDomainError(option, "Expected size in bytes, optionally with K, M or G suffix");
+    }
+
+    if (errno == ERANGE || size > std::numeric_limits<size_t>::max() / multiplier)
+    {
+        throw ArgumentDomainError(option, "Size is too large");
+    }
+
+    return static_cast<size_t>(size * multiplier);
+}
+
 void CliArguments::setPort(char* optarg)
 {
     port = convertStringToInteger(std::string(optarg));
@@ -92,6 +266,100 @@ void CliArguments::setUsername(char* optarg)
     username = std::string(optarg);
 }
 
+void CliArguments::setStoreDirectory(char* optarg)
+{
+    storeDirectory = std::string(optarg);
+}
+
+void CliArguments::setOutputDirectory(char* optarg)
+{
+    outputDirectory = std::string(optarg);
+}
+
+void CliArguments::setIoBackend(char* optarg)
+{
+    std::string backend(optarg);
+
+    if (backend == "classic")
+    {
+        ioBackend = SocketBackend::CLASSIC;
+    }
+    else if (backend == "uring")
+    {
+        ioBackend = SocketBackend::IO_URING;
+    }
+    else
+    {
+        throw ArgumentDomainError("-i", "Unknown backend (classic or uring)");
+    }
+}
+
+void CliArguments::setSocketOptions(char* optarg)
+{
+    std::stringstream list(optarg);
+    std::string option;
+
+    while (std::getline(list, option, ','))
+    {
+        if (option == "nodelay")
+        {
+            socketOptions.noDelay = true;
+        }
+        else if (option == "delay")
+        {
+            socketOptions.noDelay = false;
+        }
+        else if (option == "cork")
+        {
+            socketOptions.cork = true;
+        }
+        else if (option.compare(0, 7, "rcvbuf=") == 0)
+        {
+            socketOptions.receiveBufferSize = convertStringToSize("-O rcvbuf", option.substr(7));
+        }
+        else
+        {
+            throw ArgumentDomainError("-O", "Unknown option (nodelay, delay, cork or rcvbuf=size)");
+        }
+    }
+}
+
+void CliArguments::setPollInterval(char* optarg)
+{
+    int interval = convertStringToInteger(optarg);
+
+    if (interval <= 0)
+    {
+        throw ArgumentDomainError("-t", "Poll interval must be number of seconds greater than 0");
+    }
+
+    pollInterval = interval;
+}
+
+void CliArguments::setBatchWorkers(char* optarg)
+{
+    int workers = convertStringToInteger(optarg);
+
+    if (workers <= 0)
+    {
+        throw ArgumentDomainError("-j", "Number of workers must be greater than 0");
+    }
+
+    batchWorkers = workers;
+}
+
+void CliArguments::setHostConnections(char* optarg)
+{
+    int connections = convertStringToInteger(optarg);
+
+    if (connections <= 0)
+    {
+        throw ArgumentDomainError("-H", "Number of sessions per host must be greater than 0");
+    }
+
+    hostConnections = connections;
+}
+
 void CliArguments::setMessageId(char* optarg)
 {
     messageId = convertStringToInteger(optarg);
@@ -16,6 +16,8 @@
 
 #include "config.h"
 #include "error.h"
+#include "socket.h"
+#include "socketbackend.h"
 
 /**
  * @brief Interface to CLI arguments
@@ -35,6 +37,26 @@ class CliArguments
       std::string username;
       std::string hostname;
       int messageId;
+      std::string storeDirectory;
+      std::string outputDirectory;
+      size_t maxMessageSize;
+      size_t byteBudget;
+      bool raw;
+      bool deleteMessages;
+      SocketBackend::Type ioBackend;
+      Socket::Options socketOptions;
+      std::string accountsFile;
+      bool indexMessages;
+      std::string query;
+      bool verify;
+      std::string profileCache;
+      std::string filterFile;
+      bool transcode;
+      std::string archiveDirectory;
+      std::string extractDigest;
+      unsigned pollInterval;
+      unsigned batchWorkers;
+      unsigned hostConnections;
 
     public:
         CliArguments();
@@ -58,15 +80,46 @@ class CliArguments
         std::string getHostname() const { return hostname; }
         int getMessageId() const { return messageId; }
 
+        std::string getStoreDirectory() const { return storeDirectory; }
+        std::string getOutputDirectory() const { return outputDirectory; }
+        size_t getMaxMessageSize() const { return maxMessageSize; }
+        size_t getByteBudget() const { return byteBudget; }
+        SocketBackend::Type getIoBackend() const { return ioBackend; }
+        Socket::Options getSocketOptions() const { return socketOptions; }
+        std::string getAccountsFile() const { return accountsFile; }
+        unsigned getPollInterval() const { return pollInterval; }
+        unsigned getBatchWorkers() const { return batchWorkers; }
+        unsigned getHostConnections() const { return hostConnections; }
+
         bool isMessageIdSet() const { return messageId != 0; }
+        bool isRawSet() const { return raw; }
+        bool isDeleteSet() const { return deleteMessages; }
+        bool isStoreDirectorySet() const { return storeDirectory.length() > 0; }
+        bool isOutputDirectorySet() const { return outputDirectory.length() > 0; }
+        bool isDaemonSet() const { return accountsFile.length() > 0; }
+        bool isBatchSet() const { return batchWorkers > 0; }
+        bool isIndexSet() const { return indexMessages; }
+        bool isQuerySet() const { return query.length() > 0; }
+        std::string getQuery() const { return query; }
+        bool isVerifySet() const { return verify; }
+        std::string getProfileCache() const { return profileCache; }
+        bool isFilterSet() const { return filterFile.length() > 0; }
+        std::string getFilterFile() const { return filterFile; }
+        bool isTranscodeSet() const { return transcode; }
+        bool isArchiveSet() const { return archiveDirectory.length() > 0; }
+        std::string getArchiveDirectory() const { return archiveDirectory; }
+        bool isExtractSet() const { return extractDigest.length() > 0; }
+        std::string getExtractDigest() const { return extractDigest; }
 
         /* Exceptions */
         class GetoptError;
         class ArgumentDomainError;
         class MissingArgumentError;
+        class ConflictingArgumentsError;
 
     private:
         static int convertStringToInteger(std::string numberStoredInString);
+        static size_t convertStringToSize(std::string const& option, std::string sizeStoredInString);
 
         /* Internal methods that convert argument values from string
            to their respective types, check their domain and store
@@ -75,6 +128,13 @@ class CliArguments
         void setHostname(char* optarg);
         void setUsername(char* optarg);
         void setMessageId(char* optarg);
+        void setStoreDirectory(char* optarg);
+        void setOutputDirectory(char* optarg);
+        void setIoBackend(char* optarg);
+        void setSocketOptions(char* optarg);
+        void setPollInterval(char* optarg);
+        void setBatchWorkers(char* optarg);
+        void setHostConnections(char* optarg);
 
         void checkMandatoryArguments() const;
 };
@@ -124,6 +184,19 @@ class CliArguments::MissingArgumentError : public Error
         }
 };
 
+/**
+ * @brief Indicates options that can't be used together.
+ */
+class CliArguments::ConflictingArgumentsError : public Error
+{
+    public:
+        ConflictingArgumentsError(std::string const& first, std::string const& second)
+        {
+            problem = "Conflicting arguments";
+            reason  = first + " and " + second + " can't be used together";
+        }
+};
+
 
 #endif
 
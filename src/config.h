@@ -22,4 +22,17 @@
    the server doesn't respond */
 #define __SOCKET_READ_TIMEOUT 30 // seconds
 
+/* Daemon mode polls each account at least this
+   often and backs off up to the maximum. */
+#define __POLL_INTERVAL 60 // seconds
+#define __POLL_INTERVAL_MAX 3600 // seconds
+
+/* Batch mode opens at most this many sessions
+   to a host at the same time. */
+#define __HOST_CONNECTIONS 2
+
+/* Cached server capabilities and addresses
+   are discovered again after this time. */
+#define __PROFILE_MAX_AGE 86400 // seconds
+
 #endif
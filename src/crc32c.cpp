@@ -0,0 +1,256 @@
+/**
+ * @brief Implementation of Crc32c
+ *
+ * @file crc32c.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define CRC32C_HARDWARE
+#endif
+
+namespace
+{
+    /* The Castagnoli polynomial, bit-reflected */
+    const uint32_t POLYNOMIAL = 0x82f63b78;
+
+    /* Lengths of the three interleaved streams of the hardware version */
+    const size_t LONG_STREAM  = 8192;
+    const size_t SHORT_STREAM = 256;
+
+    typedef uint32_t (*UpdateFunction)(uint32_t state, const unsigned char* data, size_t length);
+
+#ifdef CRC32C_HARDWARE
+    /**
+     * @brief Multiply two polynomials modulo POLYNOMIAL.
+     *
+     *  Both are bit-reflected, x^0 is the highest bit.
+     */
+    uint32_t multiply(uint32_t a, uint32_t b)
+    {
+        uint32_t product = 0;
+        for (uint32_t mask = 0x80000000; mask != 0; mask >>= 1)
+        {
+            if (a & mask)
+            {
+                product ^= b;
+            }
+            b = (b & 1) ? (b >> 1) ^ POLYNOMIAL : b >> 1;
+        }
+        return product;
+    }
+
+    /**
+     * @brief x^exponent modulo POLYNOMIAL, bit-reflected.
+     */
+    uint32_t power(uint64_t exponent)
+    {
+        uint32_t result = 0x80000000; /* x^0 */
+        uint32_t square = 0x40000000; /* x^1 */
+        while (exponent > 0)
+        {
+            if (exponent & 1)
+            {
+                result = multiply(result, square);
+            }
+            square = multiply(square, square);
+            exponent >>= 1;
+        }
+        return result;
+    }
+#endif
+
+    struct Tables
+    {
+        uint32_t slices[8][256];
+
+        Tables()
+        {
+            for (unsigned i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    value = (value & 1) ? (value >> 1) ^ POLYNOMIAL : value >> 1;
+                }
+                slices[0][i] = value;
+            }
+
+            for (unsigned i = 0; i < 256; i++)
+            {
+                for (int slice = 1; slice < 8; slice++)
+                {
+                    uint32_t previous = slices[slice - 1][i];
+                    slices[slice][i] = (previous >> 8) ^ slices[0][previous & 0xff];
+                }
+            }
+        }
+    };
+
+    Tables const& getTables()
+    {
+        static const Tables tables;
+        return tables;
+    }
+
+    uint32_t updateTable(uint32_t state, const unsigned char* data, size_t length)
+    {
+        Tables const& tables = getTables();
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        while (length >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            word ^= state;
+
+            state = tables.slices[7][word & 0xff]         ^ tables.slices[6][(word >> 8) & 0xff] ^
+                    tables.slices[5][(word >> 16) & 0xff] ^ tables.slices[4][(word >> 24) & 0xff] ^
+                    tables.slices[3][(word >> 32) & 0xff] ^ tables.slices[2][(word >> 40) & 0xff] ^
+                    tables.slices[1][(word >> 48) & 0xff] ^ tables.slices[0][word >> 56];
+
+            data   += 8;
+            length -= 8;
+        }
+#endif
+
+        while (length > 0)
+        {
+            state = (state >> 8) ^ tables.slices[0][(state ^ *data) & 0xff];
+            data++;
+            length--;
+        }
+
+        return state;
+    }
+
+#ifdef CRC32C_HARDWARE
+    /* Multipliers that move a checksum over 1x and 2x the stream
+       length. Shifting by n bytes multiplies by x^(8n); the crc32
+       instruction that reduces the product adds another x^33. */
+    struct Shifts
+    {
+        uint32_t longOnce, longTwice;
+        uint32_t shortOnce, shortTwice;
+
+        Shifts()
+            : longOnce(power(8 * LONG_STREAM - 33)), longTwice(power(16 * LONG_STREAM - 33)),
+              shortOnce(power(8 * SHORT_STREAM - 33)), shortTwice(power(16 * SHORT_STREAM - 33))
+        {}
+    };
+
+    __attribute__((target("sse4.2,pclmul")))
+    uint64_t shift(uint64_t first, uint32_t twice, uint64_t second, uint32_t once)
+    {
+        __m128i product = _mm_xor_si128(
+            _mm_clmulepi64_si128(_mm_cvtsi64_si128(first), _mm_cvtsi32_si128(twice), 0),
+            _mm_clmulepi64_si128(_mm_cvtsi64_si128(second), _mm_cvtsi32_si128(once), 0));
+
+        return _mm_crc32_u64(0, _mm_cvtsi128_si64(product));
+    }
+
+    __attribute__((target("sse4.2,pclmul")))
+    uint32_t updateHardware(uint32_t state, const unsigned char* data, size_t length)
+    {
+        static const Shifts shifts;
+        uint64_t crc = state;
+
+        /* Three streams hide the latency of the instruction. */
+        while (length >= 3 * SHORT_STREAM)
+        {
+            size_t stream = length >= 3 * LONG_STREAM ? LONG_STREAM : SHORT_STREAM;
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+
+            for (size_t i = 0; i < stream; i += 8)
+            {
+                uint64_t word0, word1, word2;
+                memcpy(&word0, data + i, 8);
+                memcpy(&word1, data + stream + i, 8);
+                memcpy(&word2, data + 2 * stream + i, 8);
+
+                crc  = _mm_crc32_u64(crc, word0);
+                crc1 = _mm_crc32_u64(crc1, word1);
+                crc2 = _mm_crc32_u64(crc2, word2);
+            }
+
+            if (stream == LONG_STREAM)
+            {
+                crc = shift(crc, shifts.longTwice, crc1, shifts.longOnce) ^ crc2;
+            }
+            else
+            {
+                crc = shift(crc, shifts.shortTwice, crc1, shifts.shortOnce) ^ crc2;
+            }
+
+            data   += 3 * stream;
+            length -= 3 * stream;
+        }
+
+        while (length >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, data, 8);
+            crc = _mm_crc32_u64(crc, word);
+
+            data   += 8;
+            length -= 8;
+        }
+
+        while (length > 0)
+        {
+            crc = _mm_crc32_u8(crc, *data);
+            data++;
+            length--;
+        }
+
+        return crc;
+    }
+#endif
+
+    struct Implementation
+    {
+        UpdateFunction update;
+        const char* name;
+
+        Implementation()
+            : update(updateTable), name("table")
+        {
+#ifdef CRC32C_HARDWARE
+            if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul"))
+            {
+                update = updateHardware;
+                name   = "sse4.2";
+            }
+#endif
+        }
+    };
+
+    Implementation const& getSelected()
+    {
+        static const Implementation implementation;
+        return implementation;
+    }
+}
+
+Crc32c::Crc32c()
+{
+    reset();
+}
+
+void Crc32c::update(const char* data, size_t length)
+{
+    state = getSelected().update(state, reinterpret_cast<const unsigned char*>(data), length);
+}
+
+const char* Crc32c::getImplementation()
+{
+    return getSelected().name;
+}
@@ -0,0 +1,59 @@
+/**
+ * @brief CRC-32C checksum
+ *
+ * @file crc32c.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _CRC32C__H
+#define _CRC32C__H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Incremental CRC-32C (Castagnoli) computation.
+ *
+ *  The checksum used by iSCSI, ext4 and btrfs. It's cheap enough
+ *  to be computed while a message is being written out: on x86-64
+ *  CPUs with SSE4.2 the crc32 instruction runs three independent
+ *  streams over large buffers, which are joined with carry-less
+ *  multiplication (PCLMULQDQ). Other CPUs use a slicing-by-8
+ *  table lookup. The implementation is chosen at run time.
+ */
+class Crc32c
+{
+    uint32_t state;
+
+    public:
+        Crc32c();
+
+        /**
+         * @brief Forget everything and start a new checksum.
+         *
+         * @return void
+         */
+        void reset() { state = 0xffffffff; }
+
+        /**
+         * @brief Add data to the checksum.
+         *
+         * @param[in] data Input data.
+         * @param[in] length Number of bytes in \c data.
+         * @return void
+         */
+        void update(const char* data, size_t length);
+
+        /**
+         * @brief The checksum of the data added since the last reset().
+         */
+        uint32_t getValue() const { return ~state; }
+
+        /**
+         * @brief Name of the implementation in use ("sse4.2" or "table").
+         */
+        static const char* getImplementation();
+};
+
+#endif
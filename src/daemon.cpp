@@ -0,0 +1,225 @@
+/**
+ * @brief Implementation of Daemon
+ *
+ * @file daemon.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "daemon.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <pthread.h>
+#include <time.h>
+
+#include "error.h"
+#include "fetcher.h"
+#include "journal.h"
+#include "messagedirectory.h"
+#include "searchindex.h"
+
+volatile sig_atomic_t Daemon::stopRequested = 0;
+
+Daemon::Daemon(AccountList const& accounts, CliArguments const& options)
+    : arguments(options), profiles(options.getProfileCache()), minInterval(options.getPollInterval()),
+      maxInterval(std::max(options.getPollInterval(), unsigned(__POLL_INTERVAL_MAX)))
+{
+    if (options.isFilterSet())
+    {
+        rules.reset(new FilterRules(options.getFilterFile()));
+    }
+
+    for (size_t i = 0; i < accounts.size(); i++)
+    {
+        Poll poll;
+        poll.account       = accounts[i];
+        poll.status.count  = 0;
+        poll.status.size   = 0;
+        poll.isStatusKnown = false;
+        poll.interval      = minInterval;
+
+        polls.push_back(poll);
+    }
+}
+
+void Daemon::run()
+{
+    struct sigaction action = {};
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    /* The signals are held back while a poll runs, so that they
+       don't interrupt its system calls; they arrive between the
+       polls. */
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+
+    TimerWheel wheel(getTime());
+
+    /* Spread the first polls over the minimal interval. */
+    for (size_t i = 0; i < polls.size(); i++)
+    {
+        wheel.schedule(i, 1 + i * minInterval / polls.size());
+    }
+
+    std::vector<int> expired;
+    while (!stopRequested)
+    {
+        struct timespec idle = {};
+        idle.tv_sec = wheel.getIdleTicks();
+        nanosleep(&idle, NULL); /* Cut short by the signals. */
+
+        expired.clear();
+        wheel.advance(getTime(), &expired);
+
+        for (std::vector<int>::iterator key = expired.begin(); key != expired.end(); key++)
+        {
+            if (!stopRequested)
+            {
+                pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+                poll(&polls[*key]);
+                pthread_sigmask(SIG_UNBLOCK, &stopSignals, NULL);
+            }
+            wheel.schedule(*key, polls[*key].interval);
+        }
+    }
+}
+
+void Daemon::poll(Poll* poll)
+{
+    ServerProfile const cached = profiles.get(poll->account.hostname, poll->account.port);
+    ServerProfile profile = cached;
+
+    try
+    {
+        Pop3Session pop3(poll->account.hostname, poll->account.port, &profile);
+
+        Pop3Session::MailboxStatus status;
+        pop3.authenticate(poll->account.username, poll->account.password, &status);
+
+        if (poll->isStatusKnown && status == poll->status)
+        {
+            poll->interval = std::min(poll->interval * 2, maxInterval);
+        }
+        else
+        {
+            fetch(poll, &pop3, status);
+            poll->interval = minInterval;
+        }
+    }
+    catch (Error& error)
+    {
+        log(poll->account, error.what());
+        poll->interval = std::min(poll->interval * 2, maxInterval);
+    }
+
+    /* Whatever was learned is true even when the session failed. The
+       file is rewritten only when there's something new besides RTT. */
+    profiles.set(poll->account.hostname, poll->account.port, profile);
+    try
+    {
+        if (profile.discovered != cached.discovered || profile.address != cached.address ||
+            profile.greeting != cached.greeting)
+        {
+            profiles.save();
+        }
+    }
+    catch (Error& error)
+    {
+        log(poll->account, error.what());
+    }
+}
+
+void Daemon::fetch(Poll* poll, Pop3Session* pop3, Pop3Session::MailboxStatus const& status)
+{
+    FetchPlanner::Limits limits;
+    limits.maxMessageSize = arguments.getMaxMessageSize();
+    limits.byteBudget     = arguments.getByteBudget();
+
+    MessageDirectory directory(poll->account.directory);
+    Journal journal(poll->account.directory + "/journal");
+
+    Fetcher fetcher(pop3, limits);
+    fetcher.setDeleteCommitted(arguments.isDeleteSet());
+    fetcher.setFilter(rules.get());
+    fetcher.setTranscoding(arguments.isTranscodeSet());
+
+    std::unique_ptr<SearchIndex> index;
+    if (arguments.isIndexSet())
+    {
+        index.reset(new SearchIndex(poll->account.directory + "/index"));
+        fetcher.setIndex(index.get());
+    }
+
+    fetcher.fetchMissing(&directory, &journal);
+
+    Fetcher::Report const& report = fetcher.getReport();
+
+    std::vector<MessageDirectory::SizeMismatch> const& mismatches = directory.getSizeMismatches();
+    for (std::vector<MessageDirectory::SizeMismatch>::const_iterator mismatch = mismatches.begin();
+         mismatch != mismatches.end();
+         mismatch++)
+    {
+        std::stringstream message;
+        message << mismatch->path << " has " << mismatch->received
+                << " bytes, server reported " << mismatch->expected;
+        log(poll->account, message.str());
+    }
+
+    /* The status can be trusted next time only when nothing was
+       left behind that a later poll should pick up. */
+    poll->status        = status;
+    poll->isStatusKnown = report.refused == 0 && report.undeleted == 0 &&
+                          (report.skipped == 0 || arguments.getByteBudget() == 0);
+
+    if (arguments.isDeleteSet())
+    {
+        poll->isStatusKnown = poll->isStatusKnown && report.deleted == status.count;
+        poll->status.count  = 0;
+        poll->status.size   = 0;
+    }
+
+    if (report.retrieved > 0 || report.deleted > 0 || report.discarded > 0)
+    {
+        std::stringstream message;
+        message << "Saved " << report.retrieved << " message(s)";
+        if (arguments.isDeleteSet())
+        {
+            message << ", deleted " << report.deleted;
+        }
+        if (report.filtered > 0 || report.discarded > 0)
+        {
+            message << ", filtered " << report.filtered << ", discarded " << report.discarded;
+        }
+        log(poll->account, message.str());
+    }
+}
+
+void Daemon::log(Account const& account, std::string const& message) const
+{
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    std::cout << timestamp << " " << account.getName() << ": " << message << std::endl;
+}
+
+uint64_t Daemon::getTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec;
+}
+
+void Daemon::stop(int signalNumber)
+{
+    stopRequested = 1;
+}
@@ -0,0 +1,88 @@
+/**
+ * @brief Periodic polling of many accounts
+ *
+ * @file daemon.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _DAEMON__H
+#define _DAEMON__H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <stdint.h>
+
+#include "accountlist.h"
+#include "cliarguments.h"
+#include "filterrules.h"
+#include "pop3session.h"
+#include "serverprofile.h"
+#include "timerwheel.h"
+
+/**
+ * @brief Keeps the accounts from an AccountList downloaded.
+ *
+ *  Every account has its own timer in a TimerWheel (one tick is
+ *  one second). A poll costs one round trip after the greeting:
+ *  USER, PASS and STAT are pipelined and when the maildrop status
+ *  is the same as last time, the session ends right away. Only a
+ *  changed mailbox is fetched (into the account's directory, with
+ *  a journal, the same way as -d does).
+ *
+ *  Polling backs off on idle accounts: each poll that finds nothing
+ *  new (or fails) doubles the interval up to the maximum, and a
+ *  change resets it to the minimum.
+ *
+ *  POP3 servers show a session the maildrop as it was at login, so
+ *  a connection can't be kept open to watch for new messages; each
+ *  poll opens a new one.
+ */
+class Daemon
+{
+    struct Poll
+    {
+        Account account;
+        Pop3Session::MailboxStatus status; /*< Status when last fetched */
+        bool isStatusKnown;
+        unsigned interval;                 /*< Seconds */
+    };
+
+    std::vector<Poll> polls;
+    CliArguments const& arguments;
+    ProfileCache profiles;
+    std::unique_ptr<FilterRules> rules;
+    unsigned minInterval;
+    unsigned maxInterval;
+
+    static volatile sig_atomic_t stopRequested;
+
+    public:
+        /**
+         * @param[in] accounts Accounts to poll.
+         * @param[in] options Limits and the deletion flag for fetching.
+         */
+        Daemon(AccountList const& accounts, CliArguments const& options);
+
+        /**
+         * @brief Poll the accounts until SIGINT or SIGTERM arrives.
+         *
+         *  A poll that is in progress is finished first.
+         *
+         * @return void
+         */
+        void run();
+
+    private:
+        void poll(Poll* poll);
+        void fetch(Poll* poll, Pop3Session* pop3, Pop3Session::MailboxStatus const& status);
+        void log(Account const& account, std::string const& message) const;
+
+        static uint64_t getTime();
+        static void stop(int signalNumber);
+};
+
+#endif
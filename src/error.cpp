@@ -28,18 +28,18 @@ Error::~Error() throw()
 
 const char* Error::what() const throw()
 {
-    std::string message = programName;
+    report = programName;
 
     if (problem.length() > 0)
     {
-        message += ": " + problem;
+        report += ": " + problem;
     }
 
     if (reason.length() > 0)
     {
-        message += ": " + reason;
+        report += ": " + reason;
     }
 
-    return message.c_str();
+    return report.c_str();
 }
 
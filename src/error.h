@@ -26,6 +26,8 @@ class Error : public std::exception
         std::string problem;
         std::string reason;
 
+        mutable std::string report; /*< Keeps the buffer returned by what() */
+
     public:
         Error(std::string what = "", std::string why = "");
         virtual ~Error() throw();
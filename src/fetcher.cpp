@@ -0,0 +1,381 @@
+/**
+ * @brief Implementation of Fetcher
+ *
+ * @file fetcher.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "fetcher.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /**
+     * @brief Keeps the headers from TOP for the filter.
+     */
+    class HeaderSink : public MessageSink
+    {
+        std::map<int, std::string> headers;
+        std::string* current;
+
+        public:
+            HeaderSink() : current(NULL) {}
+
+            void begin(MessageInfo const& message) { current = &headers[message.id]; }
+            void write(const char* data, size_t length) { current->append(data, length); }
+
+            std::string const& get(int id) { return headers[id]; }
+            void clear() { headers.clear(); }
+    };
+
+    /**
+     * @brief Asks the pipeline for a commit whenever a batch is done.
+     *
+     *  The messages of all the batches arrive in one stream; a batch
+     *  is done when a message of the next one begins.
+     */
+    class BatchSink : public MessageSink
+    {
+        PipelinedSink* pipeline;
+        std::map<int, size_t> batchOf;
+        size_t currentBatch;
+
+        public:
+            BatchSink(PipelinedSink* target, std::vector<FetchPlanner::Batch> const& batches)
+                : pipeline(target), currentBatch(0)
+            {
+                for (size_t i = 0; i < batches.size(); i++)
+                {
+                    for (size_t j = 0; j < batches[i].messages.size(); j++)
+                    {
+                        batchOf[batches[i].messages[j].id] = i;
+                    }
+                }
+            }
+
+            void begin(MessageInfo const& message)
+            {
+                size_t batch = batchOf[message.id];
+                if (batch != currentBatch)
+                {
+                    pipeline->requestCommit();
+                    currentBatch = batch;
+                }
+                pipeline->begin(message);
+            }
+
+            void write(const char* data, size_t length) { pipeline->write(data, length); }
+            void end() { pipeline->end(); }
+    };
+}
+
+Fetcher::Report::Report()
+    : retrieved(0), bytes(0), present(0), incomplete(0), skipped(0), refused(0),
+      deleted(0), undeleted(0), filtered(0), deferred(0), discarded(0), resumable(true)
+{}
+
+Fetcher::Fetcher(Pop3Session* pop3, FetchPlanner::Limits const& fetchLimits)
+    : session(pop3), limits(fetchLimits), deleteCommitted(false), index(NULL), filter(NULL),
+      transcoding(false)
+{}
+
+void Fetcher::fetchOne(int messageId, MessageSink* sink)
+{
+    report = Report();
+    committed.clear();
+    discarded.clear();
+
+    MessageInfo message(messageId);
+    session->getUniqueId(messageId, &message.uid);
+
+    if (transcoding)
+    {
+        TranscodingSink transcoder(sink);
+        session->retrieveMessage(message, &transcoder);
+    }
+    else
+    {
+        session->retrieveMessage(message, sink);
+    }
+    sink->commit();
+
+    committed.push_back(messageId);
+    report.retrieved = 1;
+
+    deleteMessages();
+}
+
+void Fetcher::fetchAll(MessageSink* sink)
+{
+    report = Report();
+    committed.clear();
+    discarded.clear();
+
+    std::vector<MessageInfo> messages;
+    session->getMessageList(&messages);
+    session->getUniqueIds(&messages);
+
+    fetch(messages, sink);
+    deleteMessages();
+}
+
+void Fetcher::fetchNew(MessageSink* sink, std::set<std::string> const& knownUids)
+{
+    report = Report();
+    committed.clear();
+    discarded.clear();
+
+    std::vector<MessageInfo> messages;
+    session->getMessageList(&messages);
+
+    if (!session->getUniqueIds(&messages))
+    {
+        report.resumable = false;
+
+        fetch(messages, sink);
+        deleteMessages();
+        return;
+    }
+
+    std::vector<MessageInfo> unknown;
+    for (std::vector<MessageInfo>::iterator message = messages.begin();
+         message != messages.end();
+         message++)
+    {
+        if (knownUids.count(message->uid) > 0)
+        {
+            committed.push_back(message->id);
+            report.present++;
+            continue;
+        }
+
+        unknown.push_back(*message);
+    }
+
+    fetch(unknown, sink);
+    deleteMessages();
+}
+
+void Fetcher::fetchMissing(MessageDirectory* directory, Journal* journal)
+{
+    report = Report();
+    committed.clear();
+    discarded.clear();
+
+    std::vector<MessageInfo> messages;
+    session->getMessageList(&messages);
+
+    directory->setSynchronous(true);
+
+    if (!session->getUniqueIds(&messages))
+    {
+        report.resumable = false;
+
+        if (index != NULL)
+        {
+            IndexingSink indexingSink(index, directory);
+            fetch(messages, &indexingSink);
+        }
+        else
+        {
+            fetch(messages, directory);
+        }
+        deleteMessages();
+        return;
+    }
+
+    std::vector<MessageInfo> missing;
+    for (std::vector<MessageInfo>::iterator message = messages.begin();
+         message != messages.end();
+         message++)
+    {
+        size_t storedSize;
+        bool isCompleted = journal->isCompleted(message->uid, &storedSize);
+
+        if (isCompleted && directory->isStored(*message, storedSize))
+        {
+            committed.push_back(message->id);
+            report.present++;
+            continue;
+        }
+
+        /* Truncated, missing or cut off by a crash. */
+        if (isCompleted || journal->isInterrupted(message->uid))
+        {
+            report.incomplete++;
+        }
+
+        missing.push_back(*message);
+    }
+
+    JournaledSink sink(journal, directory);
+    if (index != NULL)
+    {
+        IndexingSink indexingSink(index, &sink);
+        fetch(missing, &indexingSink);
+    }
+    else
+    {
+        fetch(missing, &sink);
+    }
+    deleteMessages();
+}
+
+void Fetcher::fetch(std::vector<MessageInfo> const& messages, MessageSink* sink)
+{
+    FetchPlanner planner(limits);
+    if (filter != NULL)
+    {
+        std::vector<MessageInfo> selected;
+        std::vector<MessageInfo> deferred;
+        applyFilter(messages, &selected, &deferred);
+        planner.plan(selected, deferred);
+    }
+    else
+    {
+        planner.plan(messages);
+    }
+
+    report.skipped += planner.getSkipped().size();
+
+    std::vector<FetchPlanner::Batch> const& batches = planner.getBatches();
+    if (batches.empty())
+    {
+        return;
+    }
+
+    /* The batches are committed in the storage thread while the next
+       ones arrive; they all are durable once the pipeline drains. All
+       of them are requested in one pipelined stream, so the session
+       keeps its window full across the batches. */
+    TranscodingSink transcoder(sink);
+    PipelinedSink pipeline(transcoding ? &transcoder : sink);
+    BatchSink batchSink(&pipeline, batches);
+
+    std::vector<MessageInfo> planned;
+    for (std::vector<FetchPlanner::Batch>::const_iterator batch = batches.begin();
+         batch != batches.end();
+         batch++)
+    {
+        planned.insert(planned.end(), batch->messages.begin(), batch->messages.end());
+    }
+
+    std::vector<int> failed;
+    session->retrieveMessages(planned, &batchSink, &failed);
+    pipeline.requestCommit();
+
+    for (std::vector<MessageInfo>::const_iterator message = planned.begin();
+         message != planned.end();
+         message++)
+    {
+        if (std::find(failed.begin(), failed.end(), message->id) == failed.end())
+        {
+            committed.push_back(message->id);
+            report.bytes += message->size;
+        }
+    }
+
+    report.retrieved += planned.size() - failed.size();
+    report.refused   += failed.size();
+
+    pipeline.drain();
+}
+
+void Fetcher::applyFilter(std::vector<MessageInfo> const& messages,
+                          std::vector<MessageInfo>* selected, std::vector<MessageInfo>* deferred)
+{
+    std::vector<FilterRules::Action> actions(messages.size());
+    std::vector<size_t> undecided;
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        if (!filter->decideBySize(messages[i].size, &actions[i]))
+        {
+            undecided.push_back(i);
+        }
+    }
+
+    HeaderSink headers;
+    for (size_t first = 0; first < undecided.size(); first += limits.batchLength)
+    {
+        size_t last = std::min(first + limits.batchLength, undecided.size());
+
+        std::vector<MessageInfo> batch;
+        for (size_t i = first; i < last; i++)
+        {
+            batch.push_back(messages[undecided[i]]);
+        }
+
+        std::vector<int> failed;
+        headers.clear();
+        session->retrieveHeaders(batch, &headers, &failed);
+
+        for (size_t i = first; i < last; i++)
+        {
+            MessageInfo const& message = messages[undecided[i]];
+            if (std::find(failed.begin(), failed.end(), message.id) == failed.end())
+            {
+                actions[undecided[i]] = filter->decide(message.size, headers.get(message.id));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        switch (actions[i])
+        {
+            case FilterRules::FETCH:
+                selected->push_back(messages[i]);
+                break;
+            case FilterRules::DEFER:
+                deferred->push_back(messages[i]);
+                report.deferred++;
+                break;
+            case FilterRules::SKIP:
+                report.filtered++;
+                break;
+            case FilterRules::DELETE:
+                discarded.push_back(messages[i].id);
+                break;
+        }
+    }
+}
+
+void Fetcher::deleteMessages()
+{
+    if (!deleteCommitted && discarded.empty())
+    {
+        return;
+    }
+
+    std::vector<int> failed;
+    deleteMessages(discarded, &failed);
+    report.discarded = discarded.size() - failed.size();
+    report.undeleted = failed.size();
+
+    if (deleteCommitted)
+    {
+        failed.clear();
+        deleteMessages(committed, &failed);
+        report.deleted    = committed.size() - failed.size();
+        report.undeleted += failed.size();
+    }
+
+    /* The deletes count only when QUIT succeeds. */
+    session->quit();
+}
+
+void Fetcher::deleteMessages(std::vector<int> const& messageIds, std::vector<int>* failed)
+{
+    for (size_t first = 0; first < messageIds.size(); first += DELETE_BATCH_LENGTH)
+    {
+        size_t last = std::min(first + DELETE_BATCH_LENGTH, messageIds.size());
+        std::vector<int> batch(messageIds.begin() + first, messageIds.begin() + last);
+        session->deleteMessages(batch, failed);
+    }
+}
@@ -0,0 +1,193 @@
+/**
+ * @brief Retrieval of whole mailboxes
+ *
+ * @file fetcher.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _FETCHER__H
+#define _FETCHER__H
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "fetchplanner.h"
+#include "filterrules.h"
+#include "journal.h"
+#include "messagedirectory.h"
+#include "messagesink.h"
+#include "pipelinedsink.h"
+#include "pop3session.h"
+#include "searchindex.h"
+#include "transcodingsink.h"
+
+/**
+ * @brief Downloads messages of an authenticated session.
+ *
+ *  The messages are fetched according to a FetchPlanner plan, all
+ *  of them in one pipelined stream whose depth the session adapts
+ *  to the link. The sink runs in a thread of its own (see
+ *  PipelinedSink), which commits each batch of messages while the
+ *  next one is being fetched. Only committed messages are deleted from the server
+ *  (when deletion is enabled). Nothing is printed; the outcome is
+ *  described by the Report.
+ *
+ *  With FilterRules, the messages are filtered before the plan is
+ *  made. The headers the rules need are fetched with pipelined TOP
+ *  commands, one round trip per batch. Messages without headers
+ *  (the server refused TOP) are fetched.
+ *
+ *  With transcoding on, the text of the messages is converted to
+ *  UTF-8 by a TranscodingSink in the storage thread, before it's
+ *  stored and indexed.
+ */
+class Fetcher
+{
+    public:
+        struct Report
+        {
+            size_t retrieved;   /*< Messages downloaded by this run */
+            uint64_t bytes;     /*< Their size as reported by LIST */
+            size_t present;     /*< Found complete from a previous run */
+            size_t incomplete;  /*< Found incomplete, downloaded again */
+            size_t skipped;     /*< Over the size limit or byte budget */
+            size_t refused;     /*< Server refused to send them */
+            size_t deleted;     /*< Deleted from the server */
+            size_t undeleted;   /*< Server refused to delete them */
+            size_t filtered;    /*< Left on the server by the rules */
+            size_t deferred;    /*< Fetched last because of the rules */
+            size_t discarded;   /*< Deleted by the rules without downloading */
+            bool resumable;     /*< False when the server lacks UIDL */
+
+            Report();
+        };
+
+    private:
+        static const size_t DELETE_BATCH_LENGTH = 64;
+
+        Pop3Session* session;
+        FetchPlanner::Limits limits;
+        bool deleteCommitted;
+        SearchIndex* index;
+        FilterRules const* filter;
+        bool transcoding;
+
+        Report report;
+        std::vector<int> committed;
+        std::vector<int> discarded;
+
+    public:
+        /**
+         * @param[in] pop3 Authenticated session.
+         * @param[in] fetchLimits Limits for the FetchPlanner.
+         */
+        Fetcher(Pop3Session* pop3, FetchPlanner::Limits const& fetchLimits);
+
+        /**
+         * @brief Delete the messages once they are stored.
+         *
+         *  When enabled, each fetch ends the session with quit(),
+         *  because that's when the server deletes the messages.
+         *
+         * @param[in] enabled Turn it on or off (default).
+         * @return void
+         */
+        void setDeleteCommitted(bool enabled) { deleteCommitted = enabled; }
+
+        /**
+         * @brief Index the messages saved by fetchMissing().
+         *
+         *  The messages are added to \c searchIndex once they are
+         *  committed to the directory.
+         *
+         * @param[in] searchIndex The index, NULL turns indexing off.
+         * @return void
+         */
+        void setIndex(SearchIndex* searchIndex) { index = searchIndex; }
+
+        /**
+         * @brief Filter the messages of fetchAll(), fetchNew() and fetchMissing().
+         *
+         *  Messages the rules delete are deleted even when deletion
+         *  isn't enabled, and the session ends with quit() then.
+         *
+         * @param[in] rules The rules, NULL turns filtering off.
+         * @return void
+         */
+        void setFilter(FilterRules const* rules) { filter = rules; }
+
+        /**
+         * @brief Convert the text of the messages to UTF-8.
+         *
+         * @param[in] enabled Turn it on or off (default).
+         * @return void
+         */
+        void setTranscoding(bool enabled) { transcoding = enabled; }
+
+        /**
+         * @brief Fetch a single message.
+         *
+         *  The sink gets the unique id of the message when the
+         *  server supports UIDL.
+         *
+         * @param[in] messageId Id of the message.
+         * @param[in] sink Where to put the message.
+         * @return void
+         */
+        void fetchOne(int messageId, MessageSink* sink);
+
+        /**
+         * @brief Fetch all the messages.
+         *
+         *  The sink gets their unique ids when the server supports
+         *  UIDL.
+         *
+         * @param[in] sink Where to put the messages.
+         * @return void
+         */
+        void fetchAll(MessageSink* sink);
+
+        /**
+         * @brief Fetch the messages with unique ids that aren't known.
+         *
+         *  The known messages count as present, and as committed when
+         *  deletion is enabled. When the server doesn't support UIDL,
+         *  all the messages are fetched.
+         *
+         * @param[in] sink Where to put the messages. It gets their
+         *                 unique ids.
+         * @param[in] knownUids Unique ids of the messages the sink
+         *                      already has.
+         * @return void
+         */
+        void fetchNew(MessageSink* sink, std::set<std::string> const& knownUids);
+
+        /**
+         * @brief Fetch the messages missing in a directory.
+         *
+         *  The progress is recorded in \c journal, so a download that
+         *  was interrupted continues where it stopped, and the files
+         *  that are incomplete are fetched again. The directory is
+         *  switched to synchronous mode. When the server doesn't
+         *  support UIDL, all the messages are fetched.
+         *
+         * @param[in] directory Where to put the messages.
+         * @param[in] journal Progress of the downloads to this directory.
+         * @return void
+         */
+        void fetchMissing(MessageDirectory* directory, Journal* journal);
+
+        Report const& getReport() const { return report; }
+
+    private:
+        void fetch(std::vector<MessageInfo> const& messages, MessageSink* sink);
+        void applyFilter(std::vector<MessageInfo> const& messages,
+                         std::vector<MessageInfo>* selected, std::vector<MessageInfo>* deferred);
+        void deleteMessages();
+        void deleteMessages(std::vector<int> const& messageIds, std::vector<int>* failed);
+};
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @brief Implementation of FetchPlanner
+ *
+ * @file fetchplanner.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "fetchplanner.h"
+
+#include <vector>
+
+FetchPlanner::Limits::Limits()
+    : maxMessageSize(0), byteBudget(0), smallMessageSize(64 * 1024),
+      batchLength(16), batchBytes(1024 * 1024)
+{}
+
+FetchPlanner::FetchPlanner(Limits const& fetchLimits)
+    : limits(fetchLimits), plannedBytes(0)
+{}
+
+void FetchPlanner::plan(std::vector<MessageInfo> const& messages,
+                        std::vector<MessageInfo> const& deferred)
+{
+    batches.clear();
+    skipped.clear();
+    plannedBytes = 0;
+
+    planGroup(messages);
+    planGroup(deferred);
+}
+
+void FetchPlanner::planGroup(std::vector<MessageInfo> const& messages)
+{
+    std::vector<MessageInfo> large;
+    Batch batch;
+    batch.bytes = 0;
+
+    /* Small messages go first, in batches. */
+    for (std::vector<MessageInfo>::const_iterator message = messages.begin();
+         message != messages.end();
+         message++)
+    {
+        if (limits.maxMessageSize > 0 && message->size > limits.maxMessageSize)
+        {
+            skipped.push_back(*message);
+            continue;
+        }
+
+        if (message->size > limits.smallMessageSize)
+        {
+            large.push_back(*message);
+            continue;
+        }
+
+        if (!fitsBudget(*message))
+        {
+            skipped.push_back(*message);
+            continue;
+        }
+
+        if (batch.messages.size() >= limits.batchLength ||
+            (batch.messages.size() > 0 && batch.bytes + message->size > limits.batchBytes))
+        {
+            batches.push_back(batch);
+            batch.messages.clear();
+            batch.bytes = 0;
+        }
+
+        batch.messages.push_back(*message);
+        batch.bytes  += message->size;
+        plannedBytes += message->size;
+    }
+
+    if (batch.messages.size() > 0)
+    {
+        batches.push_back(batch);
+    }
+
+    /* Then the large ones, each on its own. */
+    for (std::vector<MessageInfo>::iterator message = large.begin();
+         message != large.end();
+         message++)
+    {
+        if (!fitsBudget(*message))
+        {
+            skipped.push_back(*message);
+            continue;
+        }
+
+        Batch single;
+        single.messages.push_back(*message);
+        single.bytes  = message->size;
+        plannedBytes += message->size;
+        batches.push_back(single);
+    }
+}
+
+bool FetchPlanner::fitsBudget(MessageInfo const& message) const
+{
+    return limits.byteBudget == 0 || plannedBytes + message.size <= limits.byteBudget;
+}
@@ -0,0 +1,84 @@
+/**
+ * @brief Planning of message retrieval
+ *
+ * @file fetchplanner.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _FETCHPLANNER__H
+#define _FETCHPLANNER__H
+
+#include <vector>
+
+#include "pop3session.h"
+
+/**
+ * @brief Decides in which order and groups the messages are fetched.
+ *
+ *  The plan is built from the sizes reported by LIST:
+ *
+ *    - Small messages are grouped into batches, which are committed
+ *      (and deleted) together. All the batches are retrieved in one
+ *      pipelined stream (see Pop3Session::retrieveMessages()).
+ *    - Large messages are fetched one by one after all the small
+ *      ones, so a few huge messages can't hold up the rest of the
+ *      mailbox.
+ *    - Messages over the size limit are skipped, and so are the
+ *      messages that would exceed the byte budget of the run.
+ *    - Deferred messages (see FilterRules) are planned the same way
+ *      after all the others, with what is left of the budget.
+ */
+class FetchPlanner
+{
+    public:
+        struct Limits
+        {
+            size_t maxMessageSize;   /*< 0 means unlimited */
+            size_t byteBudget;       /*< Total per run, 0 means unlimited */
+            size_t smallMessageSize; /*< Larger messages are fetched alone */
+            size_t batchLength;      /*< Max. number of messages in a batch */
+            size_t batchBytes;       /*< Max. total size of a batch */
+
+            Limits();
+        };
+
+        /**
+         * @brief Group of messages committed together.
+         */
+        struct Batch
+        {
+            std::vector<MessageInfo> messages;
+            size_t bytes;
+        };
+
+    private:
+        Limits limits;
+
+        std::vector<Batch> batches;
+        std::vector<MessageInfo> skipped;
+        size_t plannedBytes;
+
+    public:
+        FetchPlanner(Limits const& fetchLimits);
+
+        /**
+         * @brief Make a plan for the given messages.
+         *
+         * @param[in] messages Messages to fetch (usually from LIST).
+         * @param[in] deferred Messages to fetch after \c messages.
+         * @return void
+         */
+        void plan(std::vector<MessageInfo> const& messages,
+                  std::vector<MessageInfo> const& deferred = std::vector<MessageInfo>());
+
+        std::vector<Batch> const& getBatches() const { return batches; }
+        std::vector<MessageInfo> const& getSkipped() const { return skipped; }
+        size_t getPlannedBytes() const { return plannedBytes; }
+
+    private:
+        void planGroup(std::vector<MessageInfo> const& messages);
+        bool fitsBudget(MessageInfo const& message) const;
+};
+
+#endif
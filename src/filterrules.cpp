@@ -0,0 +1,239 @@
+/**
+ * @brief Implementation of FilterRules
+ *
+ * @file filterrules.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "filterrules.h"
+
+#include <cctype>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <errno.h>
+#include <stdlib.h>
+
+namespace
+{
+    std::string toLower(std::string_view text)
+    {
+        std::string lower(text);
+        for (std::string::iterator c = lower.begin(); c != lower.end(); c++)
+        {
+            if (*c >= 'A' && *c <= 'Z')
+            {
+                *c += 'a' - 'A';
+            }
+        }
+        return lower;
+    }
+
+    std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    /* "10M" -> 10485760, false when it isn't a size or doesn't fit */
+    bool parseSize(std::string const& text, size_t* size)
+    {
+        /* strtoull() takes a sign, and wraps negative numbers around. */
+        if (text.empty() || !isdigit(static_cast<unsigned char>(text[0])))
+        {
+            return false;
+        }
+
+        char* suffix;
+        errno = 0;
+        unsigned long long value = strtoull(text.c_str(), &suffix, 10);
+        unsigned long long multiplier = 1;
+
+        switch (*suffix)
+        {
+            case 'G': multiplier *= 1024;
+                      /* fall through */
+            case 'M': multiplier *= 1024;
+                      /* fall through */
+            case 'K': multiplier *= 1024;
+                      suffix++;
+                      break;
+        }
+
+        if (*suffix != '\0' || errno == ERANGE || value > std::numeric_limits<size_t>::max() / multiplier)
+        {
+            return false;
+        }
+
+        *size = static_cast<size_t>(value * multiplier);
+        return true;
+    }
+}
+
+FilterRules::FilterRules(std::string const& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        throw RulesError("Unable to open rules file", path);
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+
+        std::stringstream location;
+        location << path << ":" << lineNumber;
+
+        std::stringstream fields(line);
+        std::string action, field;
+        if (!(fields >> action) || action[0] == '#')
+        {
+            continue;
+        }
+
+        std::string pattern;
+        fields >> field;
+        std::getline(fields, pattern);
+        pattern = std::string(trim(pattern));
+
+        if (field.empty() || pattern.empty())
+        {
+            throw RulesError("Incomplete rule (action field pattern)", location.str());
+        }
+
+        Rule rule;
+        if (action == "fetch")       rule.action = FETCH;
+        else if (action == "skip")   rule.action = SKIP;
+        else if (action == "defer")  rule.action = DEFER;
+        else if (action == "delete") rule.action = DELETE;
+        else
+        {
+            throw RulesError("Unknown action (fetch, skip, defer or delete)", location.str());
+        }
+
+        rule.isLessThan = false;
+        rule.size = 0;
+        rule.field = toLower(field);
+
+        if (rule.field == "size")
+        {
+            rule.field.clear();
+            rule.isLessThan = pattern[0] == '<';
+            if ((pattern[0] != '<' && pattern[0] != '>') ||
+                !parseSize(std::string(trim(pattern.substr(1))), &rule.size))
+            {
+                throw RulesError("Size must be like >10M or <2K", location.str());
+            }
+        }
+        else
+        {
+            matcher.add(pattern);
+            patternRules.push_back(rules.size());
+        }
+
+        rules.push_back(rule);
+    }
+
+    firstHeaderRule = patternRules.empty() ? rules.size() : patternRules[0];
+    matcher.compile();
+}
+
+bool FilterRules::decideBySize(size_t size, Action* action) const
+{
+    for (size_t i = 0; i < firstHeaderRule; i++)
+    {
+        if (matchesSize(rules[i], size))
+        {
+            *action = rules[i].action;
+            return true;
+        }
+    }
+
+    *action = FETCH;
+    return firstHeaderRule == rules.size();
+}
+
+FilterRules::Action FilterRules::decide(size_t size, std::string_view header) const
+{
+    size_t first = rules.size();
+    std::vector<int> matches;
+    std::string field;
+
+    while (!header.empty())
+    {
+        size_t end = header.find('\n');
+        std::string_view line = header.substr(0, end);
+        header.remove_prefix(end == std::string_view::npos ? header.length() : end + 1);
+
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        if (!line.empty() && (line[0] == ' ' || line[0] == '\t')) /* Folded line */
+        {
+            field.append(line);
+            continue;
+        }
+
+        matchField(field, &first, &matches);
+        field.assign(line);
+
+        if (line.empty()) /* End of the header */
+        {
+            break;
+        }
+    }
+    matchField(field, &first, &matches);
+
+    for (size_t i = 0; i < first; i++)
+    {
+        if (rules[i].field.empty() && matchesSize(rules[i], size))
+        {
+            return rules[i].action;
+        }
+    }
+
+    return first < rules.size() ? rules[first].action : FETCH;
+}
+
+bool FilterRules::matchesSize(Rule const& rule, size_t size) const
+{
+    return rule.isLessThan ? size < rule.size : size > rule.size;
+}
+
+void FilterRules::matchField(std::string_view field, size_t* first, std::vector<int>* matches) const
+{
+    size_t colon = field.find(':');
+    if (colon == std::string_view::npos)
+    {
+        return;
+    }
+
+    std::string name = toLower(trim(field.substr(0, colon)));
+
+    matches->clear();
+    matcher.match(field.substr(colon + 1), matches);
+
+    for (std::vector<int>::iterator match = matches->begin(); match != matches->end(); match++)
+    {
+        size_t rule = patternRules[*match];
+        if (rule < *first && (rules[rule].field == "*" || rules[rule].field == name))
+        {
+            *first = rule;
+        }
+    }
+}
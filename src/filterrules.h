@@ -0,0 +1,120 @@
+/**
+ * @brief Rules that decide which messages are downloaded
+ *
+ * @file filterrules.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _FILTERRULES__H
+#define _FILTERRULES__H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+#include "patternmatcher.h"
+
+/**
+ * @brief Compiled list of filter rules.
+ *
+ *  Each line of the rules file is a rule:
+ *
+ *    <action> <field> <pattern>
+ *
+ *  The action is one of:
+ *
+ *    fetch   download the message (to make exceptions from later rules)
+ *    skip    leave the message on the server
+ *    defer   download the message after all the others
+ *    delete  delete the message from the server without downloading it
+ *
+ *  The field is a header field name (e.g. "from", "subject" or
+ *  "list-id", case doesn't matter), "*" for any header field, or
+ *  "size". A header rule matches when the pattern (the rest of the
+ *  line) occurs in the raw field value, ignoring case of ASCII
+ *  letters. A size rule has a pattern like ">10M" or "<2K".
+ *  Empty lines and lines starting with '#' are ignored.
+ *
+ *  The first rule that matches decides, messages that match no rule
+ *  are fetched. All the header patterns are compiled into a single
+ *  PatternMatcher, so a header is scanned only once however many
+ *  rules there are. Headers are needed only when a header rule comes
+ *  before the first size rule that matches; the other messages are
+ *  decided by the sizes from LIST alone.
+ */
+class FilterRules
+{
+    public:
+        enum Action
+        {
+            FETCH,
+            SKIP,
+            DEFER,
+            DELETE
+        };
+
+    private:
+        struct Rule
+        {
+            Action action;
+            std::string field;    /*< Lowercase field name, "*" or empty for size rules */
+            bool isLessThan;      /*< Size rules only */
+            size_t size;
+        };
+
+        std::vector<Rule> rules;
+        size_t firstHeaderRule;   /*< Index of the first header rule */
+        PatternMatcher matcher;
+        std::vector<size_t> patternRules; /*< Pattern number -> rule index */
+
+    public:
+        /**
+         * @param[in] path The rules file.
+         */
+        FilterRules(std::string const& path);
+
+        bool hasHeaderRules() const { return matcher.size() > 0; }
+
+        /**
+         * @brief Decide a message by its size, when possible.
+         *
+         * @param[in] size Size of the message from LIST.
+         * @param[out] action The decision.
+         * @return False when the headers are needed to decide.
+         */
+        bool decideBySize(size_t size, Action* action) const;
+
+        /**
+         * @brief Decide a message.
+         *
+         * @param[in] size Size of the message from LIST.
+         * @param[in] header The header of the message (e.g. from TOP),
+         *                   with \\r\\n line endings.
+         * @return The action of the first rule that matches.
+         */
+        Action decide(size_t size, std::string_view header) const;
+
+        /* Exceptions */
+        class RulesError;
+
+    private:
+        bool matchesSize(Rule const& rule, size_t size) const;
+        void matchField(std::string_view field, size_t* first, std::vector<int>* matches) const;
+};
+
+/**
+ * @brief Indicates an unreadable or malformed rules file.
+ */
+class FilterRules::RulesError : public Error
+{
+    public:
+        RulesError(std::string const& issue, std::string const& location)
+        {
+            problem = issue;
+            reason  = location;
+        }
+};
+
+#endif
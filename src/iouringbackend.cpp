@@ -0,0 +1,368 @@
+/**
+ * @brief Implementation of IoUringBackend
+ *
+ * @file iouringbackend.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "config.h"
+#include "iouringbackend.h"
+#include "socket.h"
+
+#include <algorithm>
+#include <string>
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+namespace
+{
+    /* Tags that identify completions of the chained operations. */
+    const unsigned long long SEND_TAG    = 1;
+    const unsigned long long RECEIVE_TAG = 2;
+    const unsigned long long TIMEOUT_TAG = 3;
+
+    int ioUringSetup(unsigned entries, struct io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0));
+    }
+
+    int ioUringRegister(int ringFd, unsigned opcode, void* arguments, unsigned count)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arguments, count));
+    }
+
+    unsigned* ringField(void* ring, unsigned offset)
+    {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+    }
+}
+
+IoUringBackend::IoUringBackend(int fileDescriptor, char* receiveBuffer, size_t receiveBufferSize)
+    : socketFileDescriptor(fileDescriptor), ringFileDescriptor(-1),
+      registeredBuffer(NULL), registeredBufferSize(0),
+      submissionRing(MAP_FAILED), submissionRingSize(0),
+      completionRing(MAP_FAILED), completionRingSize(0),
+      submissionEntries(static_cast<io_uring_sqe*>(MAP_FAILED)), submissionEntriesSize(0),
+      submissionPrepared(0)
+{
+    setUp();
+
+    /* Registered buffer is an optimization only; the reads
+       fall back to IORING_OP_RECV without it. */
+    struct iovec bufferVector;
+    bufferVector.iov_base = receiveBuffer;
+    bufferVector.iov_len  = receiveBufferSize;
+
+    if (ioUringRegister(ringFileDescriptor, IORING_REGISTER_BUFFERS, &bufferVector, 1) == 0)
+    {
+        registeredBuffer     = receiveBuffer;
+        registeredBufferSize = receiveBufferSize;
+    }
+}
+
+IoUringBackend::~IoUringBackend()
+{
+    try
+    {
+        flush();
+    }
+    catch (Socket::IOError& error)
+    {
+        /* The connection is going away anyway. */
+    }
+
+    tearDown();
+}
+
+void IoUringBackend::setUp()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFileDescriptor = ioUringSetup(QUEUE_DEPTH, &params);
+    if (ringFileDescriptor < 0)
+    {
+        throw Socket::IOError("io_uring unavailable", strerror(errno));
+    }
+
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping)
+    {
+        submissionRingSize = completionRingSize = std::max(submissionRingSize, completionRingSize);
+    }
+
+    submissionRing = mmap(NULL, submissionRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ringFileDescriptor, IORING_OFF_SQ_RING);
+    if (submissionRing == MAP_FAILED)
+    {
+        tearDown();
+        throw Socket::IOError("io_uring unavailable", strerror(errno));
+    }
+
+    if (singleMapping)
+    {
+        completionRing = submissionRing;
+    }
+    else
+    {
+        completionRing = mmap(NULL, completionRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ringFileDescriptor, IORING_OFF_CQ_RING);
+        if (completionRing == MAP_FAILED)
+        {
+            tearDown();
+            throw Socket::IOError("io_uring unavailable", strerror(errno));
+        }
+    }
+
+    submissionEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* entries = mmap(NULL, submissionEntriesSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringFileDescriptor, IORING_OFF_SQES);
+    submissionEntries = static_cast<io_uring_sqe*>(entries);
+    if (entries == MAP_FAILED)
+    {
+        tearDown();
+        throw Socket::IOError("io_uring unavailable", strerror(errno));
+    }
+
+    submissionTail  = ringField(submissionRing, params.sq_off.tail);
+    submissionMask  = ringField(submissionRing, params.sq_off.ring_mask);
+    submissionArray = ringField(submissionRing, params.sq_off.array);
+    completionHead  = ringField(completionRing, params.cq_off.head);
+    completionTail  = ringField(completionRing, params.cq_off.tail);
+    completionMask  = ringField(completionRing, params.cq_off.ring_mask);
+    completionEntries = reinterpret_cast<io_uring_cqe*>(
+        static_cast<char*>(completionRing) + params.cq_off.cqes);
+}
+
+void IoUringBackend::tearDown()
+{
+    if (submissionEntries != MAP_FAILED)
+    {
+        munmap(submissionEntries, submissionEntriesSize);
+    }
+
+    if (completionRing != MAP_FAILED && completionRing != submissionRing)
+    {
+        munmap(completionRing, completionRingSize);
+    }
+
+    if (submissionRing != MAP_FAILED)
+    {
+        munmap(submissionRing, submissionRingSize);
+    }
+
+    if (ringFileDescriptor >= 0)
+    {
+        ::close(ringFileDescriptor);
+    }
+}
+
+io_uring_sqe* IoUringBackend::getSubmissionEntry()
+{
+    /* Only this thread produces entries, the kernel consumes
+       all of them in io_uring_enter(), so there's always room.
+       The entry becomes visible to the kernel in submitAndWait(),
+       after the caller filled it in. */
+    unsigned index = (*submissionTail + submissionPrepared) & *submissionMask;
+    submissionPrepared++;
+
+    io_uring_sqe* entry = &submissionEntries[index];
+    memset(entry, 0, sizeof(*entry));
+    submissionArray[index] = index;
+
+    return entry;
+}
+
+void IoUringBackend::submitAndWait(unsigned count)
+{
+    /* Wait for at least one completion when there's
+       nothing to submit. */
+    unsigned minComplete = count > 0 ? count : 1;
+
+    /* Publish the prepared entries; the release store orders
+       their contents before the new tail. */
+    __atomic_store_n(submissionTail, *submissionTail + submissionPrepared, __ATOMIC_RELEASE);
+    submissionPrepared = 0;
+
+    int returnCode;
+    do
+    {
+        returnCode = ioUringEnter(ringFileDescriptor, count, minComplete, IORING_ENTER_GETEVENTS);
+    }
+    while (returnCode < 0 && errno == EINTR);
+
+    if (returnCode < 0)
+    {
+        throw Socket::IOError("Recieving error", strerror(errno));
+    }
+}
+
+bool IoUringBackend::getCompletion(unsigned long long* tag, int* result)
+{
+    unsigned head = *completionHead;
+    if (head == __atomic_load_n(completionTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    io_uring_cqe* completion = &completionEntries[head & *completionMask];
+    *tag    = completion->user_data;
+    *result = completion->res;
+
+    __atomic_store_n(completionHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void IoUringBackend::prepareSend(bool linked)
+{
+    io_uring_sqe* entry = getSubmissionEntry();
+    entry->opcode    = IORING_OP_SEND;
+    entry->fd        = socketFileDescriptor;
+    entry->addr      = reinterpret_cast<unsigned long long>(pendingSend.data());
+    entry->len       = pendingSend.length();
+    entry->user_data = SEND_TAG;
+    entry->msg_flags = MSG_NOSIGNAL;
+
+    if (linked)
+    {
+        entry->flags = IOSQE_IO_LINK;
+    }
+}
+
+void IoUringBackend::completeSend(int result)
+{
+    if (result < 0 && result != -ECANCELED)
+    {
+        throw Socket::IOError("Sending error", "Unable to send data to remote host");
+    }
+
+    if (result > 0)
+    {
+        pendingSend.erase(0, result);
+    }
+}
+
+size_t IoUringBackend::receive(char* buffer, size_t size)
+{
+    while (true)
+    {
+        unsigned submitted = 0;
+
+        if (!pendingSend.empty())
+        {
+            prepareSend(true);
+            submitted++;
+        }
+
+        io_uring_sqe* reading = getSubmissionEntry();
+        bool isRegistered = buffer >= registeredBuffer &&
+                            buffer + size <= registeredBuffer + registeredBufferSize;
+        reading->opcode    = isRegistered ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+        reading->fd        = socketFileDescriptor;
+        reading->addr      = reinterpret_cast<unsigned long long>(buffer);
+        reading->len       = size;
+        reading->user_data = RECEIVE_TAG;
+        reading->flags     = IOSQE_IO_LINK;
+        submitted++;
+
+        struct __kernel_timespec timeout;
+        timeout.tv_sec  = __SOCKET_READ_TIMEOUT;
+        timeout.tv_nsec = 0;
+
+        io_uring_sqe* timer = getSubmissionEntry();
+        timer->opcode    = IORING_OP_LINK_TIMEOUT;
+        timer->fd        = -1;
+        timer->addr      = reinterpret_cast<unsigned long long>(&timeout);
+        timer->len       = 1;
+        timer->user_data = TIMEOUT_TAG;
+        submitted++;
+
+        submitAndWait(submitted);
+
+        int received = -ECANCELED;
+        int timerResult = 0;
+        int sendResult = 0;
+        unsigned long long tag;
+        int result;
+
+        for (unsigned completed = 0; completed < submitted; )
+        {
+            if (!getCompletion(&tag, &result))
+            {
+                submitAndWait(0);
+                continue;
+            }
+
+            if (tag == SEND_TAG)         sendResult = result;
+            else if (tag == RECEIVE_TAG) received = result;
+            else                         timerResult = result;
+            completed++;
+        }
+
+        if (submitted == 3)
+        {
+            /* A short send breaks the chain; the rest is
+               sent by the next iteration. */
+            completeSend(sendResult);
+            if (received == -ECANCELED && timerResult != -ETIME)
+            {
+                continue;
+            }
+        }
+
+        if (received == -ECANCELED || timerResult == -ETIME)
+        {
+            throw Socket::IOError("Recieving error", "Server not responding (connection timed out).");
+        }
+
+        if (received < 0)
+        {
+            throw Socket::IOError("Recieving error", "Unable to resolve data from remote host");
+        }
+
+        return received;
+    }
+}
+
+void IoUringBackend::send(const char* data, size_t length)
+{
+    pendingSend.append(data, length);
+}
+
+void IoUringBackend::flush()
+{
+    while (!pendingSend.empty())
+    {
+        prepareSend(false);
+        submitAndWait(1);
+
+        unsigned long long tag;
+        int result;
+        while (!getCompletion(&tag, &result))
+        {
+            submitAndWait(0);
+        }
+
+        if (result == 0)
+        {
+            throw Socket::IOError("Sending error", "Unable to send data to remote host");
+        }
+        completeSend(result);
+    }
+}
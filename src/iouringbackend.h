@@ -0,0 +1,94 @@
+/**
+ * @brief io_uring backend of Socket
+ *
+ * @file iouringbackend.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _IOURINGBACKEND__H
+#define _IOURINGBACKEND__H
+
+#include <string>
+
+#include "socketbackend.h"
+
+struct io_uring_sqe; /* Forward-declarations, see <linux/io_uring.h> */
+struct io_uring_cqe;
+
+/**
+ * @brief Socket backend built on Linux io_uring.
+ *
+ *  The ring is driven directly through the system calls, no
+ *  liburing is needed. The Socket's receive buffer is registered
+ *  with the kernel, so reads go through IORING_OP_READ_FIXED
+ *  without mapping the buffer on every call.
+ *
+ *  Sending is postponed: send() only queues the data and they are
+ *  submitted together with the next receive() as a linked
+ *  send -> read -> timeout chain. A command and its response thus
+ *  cost one io_uring_enter() instead of the select(), write() and
+ *  read() calls of the classic backend.
+ *
+ *  Every backend has its own small ring, even when a daemon (-a) or
+ *  a batch (-j) holds many connections. Their sessions are blocking
+ *  and run in threads of their own, so submissions of different
+ *  connections are never ready together, and the read submitted
+ *  with each command leaves nothing for a multishot receive to save.
+ *  Sharing a ring would take an event loop over all the sessions;
+ *  that is intentionally not done.
+ */
+class IoUringBackend : public SocketBackend
+{
+    static const unsigned QUEUE_DEPTH = 8;
+
+    int socketFileDescriptor;
+    int ringFileDescriptor;
+
+    char* registeredBuffer;
+    size_t registeredBufferSize;
+
+    /* Memory shared with the kernel. */
+    void* submissionRing;
+    size_t submissionRingSize;
+    void* completionRing;
+    size_t completionRingSize;
+    io_uring_sqe* submissionEntries;
+    size_t submissionEntriesSize;
+
+    unsigned* submissionTail;
+    unsigned* submissionMask;
+    unsigned* submissionArray;
+    unsigned submissionPrepared; /*< Entries filled in, not yet published */
+    unsigned* completionHead;
+    unsigned* completionTail;
+    unsigned* completionMask;
+    io_uring_cqe* completionEntries;
+
+    std::string pendingSend;
+
+    public:
+        /**
+         * @throw Socket::IOError when io_uring can't be set up.
+         */
+        IoUringBackend(int fileDescriptor, char* receiveBuffer, size_t receiveBufferSize);
+        ~IoUringBackend();
+
+        Type getType() const { return IO_URING; }
+        size_t receive(char* buffer, size_t size);
+        void send(const char* data, size_t length);
+        void flush();
+
+    private:
+        void setUp();
+        void tearDown();
+
+        io_uring_sqe* getSubmissionEntry();
+        void submitAndWait(unsigned count);
+        bool getCompletion(unsigned long long* tag, int* result);
+
+        void prepareSend(bool linked);
+        void completeSend(int result);
+};
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * @brief Implementation of Journal
+ *
+ * @file journal.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "journal.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+Journal::Journal(std::string const& journalPath)
+    : path(journalPath), fileDescriptor(-1)
+{
+    load();
+    compact();
+
+    fileDescriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fileDescriptor < 0)
+    {
+        throw JournalError("Unable to open journal", path);
+    }
+}
+
+Journal::~Journal()
+{
+    if (fileDescriptor >= 0)
+    {
+        ::close(fileDescriptor);
+    }
+}
+
+bool Journal::isCompleted(std::string const& uid, size_t* size) const
+{
+    std::map<std::string, size_t>::const_iterator record = completed.find(uid);
+    if (record == completed.end())
+    {
+        return false;
+    }
+
+    *size = record->second;
+    return true;
+}
+
+bool Journal::isInterrupted(std::string const& uid) const
+{
+    return interrupted.count(uid) > 0;
+}
+
+void Journal::recordStarted(std::string const& uid)
+{
+    append("S " + uid + "\n");
+}
+
+void Journal::recordProgress(std::string const& uid, size_t bytes)
+{
+    std::stringstream record;
+    record << "P " << uid << " " << bytes << "\n";
+    append(record.str());
+}
+
+void Journal::recordCompleted(std::string const& uid, size_t bytes)
+{
+    std::stringstream record;
+    record << "C " << uid << " " << bytes << "\n";
+    append(record.str());
+
+    completed[uid] = bytes;
+    interrupted.erase(uid);
+}
+
+void Journal::load()
+{
+    std::ifstream input(path.c_str());
+    std::string line;
+
+    while (std::getline(input, line))
+    {
+        if (input.eof())
+        {
+            break; /* Last line without \n was torn by a crash. */
+        }
+
+        std::istringstream record(line);
+        char type = 0;
+        std::string uid;
+        size_t bytes = 0;
+
+        record >> type >> uid >> bytes;
+        if (record.fail() && type != 'S')
+        {
+            continue;
+        }
+
+        switch (type)
+        {
+            case 'S':
+            case 'P':
+                interrupted.insert(uid);
+                break;
+            case 'C':
+                completed[uid] = bytes;
+                interrupted.erase(uid);
+                break;
+        }
+    }
+}
+
+void Journal::compact()
+{
+    std::string temporaryPath = path + ".new";
+    std::ofstream output(temporaryPath.c_str(), std::ios::trunc);
+
+    for (std::map<std::string, size_t>::iterator record = completed.begin();
+         record != completed.end();
+         record++)
+    {
+        output << "C " << record->first << " " << record->second << "\n";
+    }
+
+    output.close();
+    if (output.fail())
+    {
+        throw JournalError("Unable to write journal", temporaryPath);
+    }
+
+    /* The interrupted downloads are known to this instance only,
+       they don't need to survive another restart. */
+    int descriptor = ::open(temporaryPath.c_str(), O_RDONLY);
+    if (descriptor < 0 || fsync(descriptor) != 0 ||
+        rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+        }
+        throw JournalError("Unable to write journal", path);
+    }
+    ::close(descriptor);
+}
+
+void Journal::commit()
+{
+    if (fdatasync(fileDescriptor) != 0)
+    {
+        throw JournalError("Unable to write journal", path);
+    }
+}
+
+void Journal::append(std::string const& record)
+{
+    /* O_APPEND makes a single write() of a record atomic
+       with respect to other records. */
+    const char* data = record.data();
+    size_t length = record.length();
+
+    while (length > 0)
+    {
+        ssize_t written = ::write(fileDescriptor, data, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            throw JournalError("Unable to write journal", path);
+        }
+        data   += written;
+        length -= written;
+    }
+}
+
+JournaledSink::JournaledSink(Journal* progressJournal, MessageSink* storage)
+    : journal(progressJournal), sink(storage), received(0), lastRecorded(0)
+{}
+
+void JournaledSink::begin(MessageInfo const& message)
+{
+    uid = message.uid;
+    received = lastRecorded = 0;
+
+    journal->recordStarted(uid);
+    sink->begin(message);
+}
+
+void JournaledSink::write(const char* data, size_t length)
+{
+    sink->write(data, length);
+    received += length;
+
+    if (received - lastRecorded >= PROGRESS_INTERVAL)
+    {
+        journal->recordProgress(uid, received);
+        lastRecorded = received;
+    }
+}
+
+void JournaledSink::end()
+{
+    sink->end();
+    finished.push_back(std::make_pair(uid, received));
+}
+
+void JournaledSink::commit()
+{
+    sink->commit();
+
+    for (size_t i = 0; i < finished.size(); i++)
+    {
+        journal->recordCompleted(finished[i].first, finished[i].second);
+    }
+    journal->commit();
+
+    finished.clear();
+}
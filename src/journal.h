@@ -0,0 +1,137 @@
+/**
+ * @brief Progress journal of a download
+ *
+ * @file journal.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _JOURNAL__H
+#define _JOURNAL__H
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "messagesink.h"
+
+/**
+ * @brief Append-only record of downloaded messages.
+ *
+ *  The journal survives crashes and dropped connections, so an
+ *  interrupted download can continue with the messages that are
+ *  still missing. Messages are identified by their unique ids
+ *  (UIDL), because the message numbers change between sessions.
+ *  Each line is one record:
+ *
+ *    S <uid>           download of a message started
+ *    P <uid> <bytes>   bytes received so far
+ *    C <uid> <bytes>   message was stored completely
+ *
+ *  A completed record is appended only after the message itself is
+ *  safely on the disk, and it counts once commit() returns. A record torn by a crash
+ *  is ignored when the journal is loaded. The journal is compacted
+ *  to the completed records on every load.
+ */
+class Journal
+{
+    std::string path;
+    int fileDescriptor;
+
+    std::map<std::string, size_t> completed;
+    std::set<std::string> interrupted;
+
+    public:
+        /**
+         * @brief Open (or create) a journal.
+         *
+         * @param[in] journalPath Path to the journal file.
+         */
+        Journal(std::string const& journalPath);
+        ~Journal();
+
+        /**
+         * @brief Look up a completed message.
+         *
+         * @param[in] uid Unique id of the message.
+         * @param[out] size Number of bytes stored.
+         * @return True when the message was downloaded completely.
+         */
+        bool isCompleted(std::string const& uid, size_t* size) const;
+
+        /**
+         * @brief Check whether a download of a message was cut off.
+         *
+         *  Only messages started but not completed before this
+         *  journal was opened are reported.
+         */
+        bool isInterrupted(std::string const& uid) const;
+
+        /* Records */
+        void recordStarted(std::string const& uid);
+        void recordProgress(std::string const& uid, size_t bytes);
+        void recordCompleted(std::string const& uid, size_t bytes);
+
+        /**
+         * @brief Flush the records to the disk.
+         *
+         * @return void
+         */
+        void commit();
+
+        /* Exceptions */
+        class JournalError;
+
+    private:
+        void load();
+        void compact();
+        void append(std::string const& record);
+};
+
+/**
+ * @brief Records downloads in a Journal.
+ *
+ *  A decorator that passes the message on to another sink and
+ *  records its progress. The messages are recorded as completed
+ *  in commit(), after the other sink committed them.
+ */
+class JournaledSink : public MessageSink
+{
+    static const size_t PROGRESS_INTERVAL = 4 * 1024 * 1024;
+
+    Journal* journal;
+    MessageSink* sink;
+
+    std::string uid;
+    size_t received;
+    size_t lastRecorded;
+
+    /* Ended, but not committed messages and their sizes */
+    std::vector<std::pair<std::string, size_t> > finished;
+
+    public:
+        JournaledSink(Journal* progressJournal, MessageSink* storage);
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+        void commit();
+};
+
+/**
+ * @brief Indicates that the journal can't be read or written.
+ */
+class Journal::JournalError : public Error
+{
+    public:
+        JournalError(std::string const& issue, std::string const& path)
+        {
+            problem = issue;
+            reason  = path;
+        }
+};
+
+#endif
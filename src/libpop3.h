@@ -0,0 +1,42 @@
+/**
+ * @brief Public interface of libpop3
+ *
+ * @file libpop3.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ *  Programs that use the library include just this header and
+ *  link with libpop3.a or libpop3.so. A minimal program opens a
+ *  Pop3Session, authenticates and passes a MessageSink (one of
+ *  the stores below or its own implementation) to a Fetcher.
+ */
+
+#ifndef _LIBPOP3__H
+#define _LIBPOP3__H
+
+#include "error.h"
+#include "messageinfo.h"
+#include "messagesink.h"
+#include "charsetconverter.h"
+#include "mimecodec.h"
+#include "pipelinewindow.h"
+#include "pop3session.h"
+#include "responseparser.h"
+#include "scanlisting.h"
+#include "socket.h"
+#include "fetchplanner.h"
+#include "fetcher.h"
+#include "filterrules.h"
+#include "crc32c.h"
+#include "journal.h"
+#include "messagedirectory.h"
+#include "messagestore.h"
+#ifdef POP3_ZSTD
+#include "messagearchive.h"
+#endif
+#include "pipelinedsink.h"
+#include "transcodingsink.h"
+#include "searchindex.h"
+#include "serverprofile.h"
+#include "timerwheel.h"
+
+#endif
@@ -37,17 +37,37 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 @endverbatim
  */
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <termios.h>
 
 #include "config.h"
 #include "error.h"
 #include "cliarguments.h"
 #include "pop3session.h"
+#include "socket.h"
+#include "messagestore.h"
+#include "messagedirectory.h"
+#include "fetcher.h"
+#include "scanlisting.h"
+#include "journal.h"
+#include "searchindex.h"
+#include "serverprofile.h"
+#include "filterrules.h"
+#include "transcodingsink.h"
+#ifdef POP3_ZSTD
+#include "messagearchive.h"
+#endif
+#include "accountlist.h"
+#include "daemon.h"
+#include "batchrunner.h"
 
 /**
  * @brief Read password from terminal (stdin)
@@ -100,15 +120,374 @@ std::string getPassword()
 void usage(int status)
 {
 
-    std::cerr << "Usage: " << __PROGRAM_NAME << " -h hostname [-p port] -u username  [id]" << std::endl;
+    std::cerr << "Usage: " << __PROGRAM_NAME << " -h hostname [-p port] -u username [-s directory | -d directory | -z directory]" << std::endl;
+    std::cerr << "                  [-D] [-x] [-m size] [-b size] [-F rules] [-U] [-r] [-i backend]" << std::endl;
+    std::cerr << "                  [-O options] [-C file] [id]" << std::endl;
+    std::cerr << "       " << __PROGRAM_NAME << " -d directory -q words" << std::endl;
+    std::cerr << "       " << __PROGRAM_NAME << " -d directory -V" << std::endl;
+    std::cerr << "       " << __PROGRAM_NAME << " -z directory -e digest" << std::endl;
+    std::cerr << "       " << __PROGRAM_NAME << " -a accounts [-t seconds] [-D] [-x] [-m size] [-b size] [-F rules] [-U]" << std::endl;
+    std::cerr << "                  [-j workers [-H sessions]] [-i backend] [-O options] [-C file]" << std::endl;
     std::cerr << "       -h hostname     remote IP address or hostname" << std::endl;
     std::cerr << "       -p port         remote TCP port" << std::endl;
     std::cerr << "       -u username     username" << std::endl;
+    std::cerr << "       -s directory    save messages into a deduplicating store" << std::endl;
+    std::cerr << "       -d directory    save messages into directory, one file each" << std::endl;
+    std::cerr << "       -z directory    save messages into a zstd-compressed archive" << std::endl;
+    std::cerr << "       -e digest       print a message from the -z archive" << std::endl;
+    std::cerr << "       -D              delete saved messages from the server" << std::endl;
+    std::cerr << "       -x              index messages saved with -d for searching" << std::endl;
+    std::cerr << "       -q words        list messages in -d directory that contain all the words" << std::endl;
+    std::cerr << "       -V              check messages in -d directory against their checksums" << std::endl;
+    std::cerr << "       -m size         skip messages larger than size (e.g. 10M)" << std::endl;
+    std::cerr << "       -b size         download at most size bytes in total" << std::endl;
+    std::cerr << "       -F rules        fetch, skip, defer or delete messages by their headers" << std::endl;
+    std::cerr << "       -U              convert the text of messages to UTF-8" << std::endl;
+    std::cerr << "       -r              print the message raw, as stored on the server" << std::endl;
+    std::cerr << "       -i backend      socket I/O backend: classic (default) or uring" << std::endl;
+    std::cerr << "       -O options      TCP options: nodelay (default), delay, cork, rcvbuf=size" << std::endl;
+    std::cerr << "       -C file         server profile cache (default ~/.cache/pop3client/servers, '' for none)" << std::endl;
+    std::cerr << "       -a accounts     keep downloading the accounts listed in a file" << std::endl;
+    std::cerr << "       -t seconds      shortest poll interval of -a (default " << __POLL_INTERVAL << ")" << std::endl;
+    std::cerr << "       -j workers      download the -a accounts once, with that many sessions at a time" << std::endl;
+    std::cerr << "       -H sessions     most sessions of -j to one host (default " << __HOST_CONNECTIONS << ")" << std::endl;
     std::cerr << "       id              id of the message to download" << std::endl;
 
     exit(status);
 }
 
+/**
+ * @brief Prints messages on the standard output.
+ *
+ *  Line endings are converted from \r\n to \n.
+ */
+class TerminalSink : public MessageSink
+{
+    bool pendingCarriageReturn;
+
+    public:
+        TerminalSink() : pendingCarriageReturn(false) {}
+
+        void write(const char* data, size_t length)
+        {
+            const char* end = data + length;
+            while (data < end)
+            {
+                if (pendingCarriageReturn && *data != '\n')
+                {
+                    std::cout.put('\r');
+                }
+                pendingCarriageReturn = false;
+
+                const char* carriageReturn = static_cast<const char*>(memchr(data, '\r', end - data));
+                if (carriageReturn == NULL)
+                {
+                    std::cout.write(data, end - data);
+                    break;
+                }
+
+                std::cout.write(data, carriageReturn - data);
+                pendingCarriageReturn = true;
+                data = carriageReturn + 1;
+            }
+        }
+
+        void end()
+        {
+            std::cout.flush();
+        }
+};
+
+/**
+ * @brief Print list of available messages.
+ *
+ *  Prints a notice when no messages are available.
+ *
+ * @param[in] pop3 Authenticated session.
+ * @return void
+ */
+void printMessageList(Pop3Session* pop3)
+{
+    ScanListing listing;
+    pop3->getListing(&listing);
+
+    if (listing.empty())
+    {
+        std::cout << "No messages available on the server." << std::endl;
+        return;
+    }
+
+    std::string output;
+    listing.formatIds(&output);
+
+    std::cout.write(output.data(), output.length());
+    std::cout.flush();
+}
+
+/**
+ * @brief Print what happened during a download.
+ *
+ * @param[in] report Report of the Fetcher.
+ * @return void
+ */
+void printReport(Fetcher::Report const& report)
+{
+    if (!report.resumable)
+    {
+        std::cerr << "Server doesn't support UIDL, download can't be resumed." << std::endl;
+    }
+
+    if (report.skipped > 0)
+    {
+        std::cerr << "Skipped " << report.skipped
+                  << " message(s) over the size limit or byte budget." << std::endl;
+    }
+
+    if (report.refused > 0)
+    {
+        std::cerr << "Server refused to send " << report.refused << " message(s)." << std::endl;
+    }
+
+    if (report.undeleted > 0)
+    {
+        std::cerr << "Server refused to delete " << report.undeleted << " message(s)." << std::endl;
+    }
+
+    if (report.filtered > 0 || report.discarded > 0)
+    {
+        std::cerr << "Filter rules left " << report.filtered << " message(s) on the server and deleted "
+                  << report.discarded << "." << std::endl;
+    }
+}
+
+/**
+ * @brief Warn about messages that don't have the size the server reported.
+ */
+void printSizeMismatches(MessageDirectory const& directory)
+{
+    std::vector<MessageDirectory::SizeMismatch> const& mismatches = directory.getSizeMismatches();
+    for (std::vector<MessageDirectory::SizeMismatch>::const_iterator mismatch = mismatches.begin();
+         mismatch != mismatches.end();
+         mismatch++)
+    {
+        std::cerr << "Warning: " << mismatch->path << " has " << mismatch->received
+                  << " bytes, server reported " << mismatch->expected << "." << std::endl;
+    }
+}
+
+/**
+ * @brief Create a Fetcher as requested on the command line.
+ */
+Fetcher createFetcher(Pop3Session* pop3, CliArguments const& arguments, FilterRules const* rules)
+{
+    FetchPlanner::Limits limits;
+    limits.maxMessageSize = arguments.getMaxMessageSize();
+    limits.byteBudget     = arguments.getByteBudget();
+
+    Fetcher fetcher(pop3, limits);
+    fetcher.setDeleteCommitted(arguments.isDeleteSet());
+    fetcher.setFilter(rules);
+    fetcher.setTranscoding(arguments.isTranscodeSet());
+
+    return fetcher;
+}
+
+/**
+ * @brief Save messages into a MessageStore.
+ *
+ *  Stores the message specified by id or all the available
+ *  messages when no id was given.
+ *
+ * @param[in] pop3 Authenticated session.
+ * @param[in] arguments Processed CLI arguments.
+ * @param[in] rules Filter rules from -F, or NULL.
+ * @return void
+ */
+void storeMessages(Pop3Session* pop3, CliArguments const& arguments, FilterRules const* rules)
+{
+    MessageStore store(arguments.getStoreDirectory(),
+                       arguments.getUsername() + "@" + arguments.getHostname());
+
+    Fetcher fetcher = createFetcher(pop3, arguments, rules);
+    if (arguments.isMessageIdSet())
+    {
+        fetcher.fetchOne(arguments.getMessageId(), &store);
+    }
+    else
+    {
+        fetcher.fetchAll(&store);
+    }
+
+    printReport(fetcher.getReport());
+    std::cout << "Stored " << store.getStoredCount() << " new message(s), "
+              << store.getDuplicateCount() << " duplicate(s)." << std::endl;
+
+    if (arguments.isDeleteSet())
+    {
+        std::cout << "Deleted " << fetcher.getReport().deleted << " message(s)." << std::endl;
+    }
+}
+
+#ifdef POP3_ZSTD
+/**
+ * @brief Save messages into a MessageArchive.
+ *
+ *  Archives the message specified by id or all the available
+ *  messages that aren't archived yet when no id was given.
+ *
+ * @param[in] pop3 Authenticated session.
+ * @param[in] arguments Processed CLI arguments.
+ * @param[in] rules Filter rules from -F, or NULL.
+ * @return void
+ */
+void archiveMessages(Pop3Session* pop3, CliArguments const& arguments, FilterRules const* rules)
+{
+    MessageArchive archive(arguments.getArchiveDirectory());
+
+    Fetcher fetcher = createFetcher(pop3, arguments, rules);
+    if (arguments.isMessageIdSet())
+    {
+        fetcher.fetchOne(arguments.getMessageId(), &archive);
+    }
+    else
+    {
+        fetcher.fetchNew(&archive, archive.getUniqueIds());
+    }
+
+    Fetcher::Report const& report = fetcher.getReport();
+    printReport(report);
+    std::cout << "Archived " << archive.getStoredCount() << " new message(s), "
+              << archive.getDuplicateCount() << " duplicate(s)";
+    if (report.present > 0)
+    {
+        std::cout << ", " << report.present << " already archived";
+    }
+    if (archive.getStoredCount() > 0)
+    {
+        std::cout << ", " << archive.getStoredBytes() << " bytes compressed to "
+                  << archive.getCompressedBytes();
+    }
+    std::cout << "." << std::endl;
+
+    if (arguments.isDeleteSet())
+    {
+        std::cout << "Deleted " << report.deleted << " message(s)." << std::endl;
+    }
+}
+#endif
+
+/**
+ * @brief Save messages into a MessageDirectory.
+ *
+ *  Saves the message specified by id or all the available messages
+ *  that are missing in the directory when no id was given.
+ *
+ * @param[in] pop3 Authenticated session.
+ * @param[in] arguments Processed CLI arguments.
+ * @param[in] rules Filter rules from -F, or NULL.
+ * @return void
+ */
+void saveMessages(Pop3Session* pop3, CliArguments const& arguments, FilterRules const* rules)
+{
+    MessageDirectory directory(arguments.getOutputDirectory());
+    directory.setSynchronous(arguments.isDeleteSet());
+
+    Fetcher fetcher = createFetcher(pop3, arguments, rules);
+    if (arguments.isMessageIdSet())
+    {
+        fetcher.fetchOne(arguments.getMessageId(), &directory);
+    }
+    else
+    {
+        Journal journal(arguments.getOutputDirectory() + "/journal");
+
+        std::unique_ptr<SearchIndex> index;
+        if (arguments.isIndexSet())
+        {
+            index.reset(new SearchIndex(arguments.getOutputDirectory() + "/index"));
+            fetcher.setIndex(index.get());
+        }
+
+        fetcher.fetchMissing(&directory, &journal);
+    }
+
+    Fetcher::Report const& report = fetcher.getReport();
+    printReport(report);
+    printSizeMismatches(directory);
+
+    std::cout << "Saved " << report.retrieved << " message(s)";
+    if (report.present > 0)
+    {
+        std::cout << ", " << report.present << " already downloaded";
+    }
+    if (report.incomplete > 0)
+    {
+        std::cout << ", " << report.incomplete << " incomplete downloaded again";
+    }
+    std::cout << "." << std::endl;
+
+    if (arguments.isDeleteSet())
+    {
+        std::cout << "Deleted " << report.deleted << " message(s)." << std::endl;
+    }
+}
+
+/**
+ * @brief Print paths of the saved messages that match a query.
+ *
+ * @param[in] arguments Processed CLI arguments.
+ * @return void
+ */
+void searchMessages(CliArguments const& arguments)
+{
+    SearchIndex index(arguments.getOutputDirectory() + "/index");
+    MessageDirectory directory(arguments.getOutputDirectory());
+
+    std::vector<std::string> keys;
+    index.search(arguments.getQuery(), &keys);
+
+    std::string output;
+    for (std::vector<std::string>::iterator key = keys.begin(); key != keys.end(); key++)
+    {
+        MessageInfo message;
+        message.uid = *key;
+
+        output += directory.getPath(message);
+        output += '\n';
+    }
+
+    std::cout.write(output.data(), output.length());
+    std::cout.flush();
+}
+
+/**
+ * @brief Check the saved messages against their checksums.
+ *
+ * @param[in] arguments Processed CLI arguments.
+ * @return True when no message is damaged.
+ */
+bool verifyMessages(CliArguments const& arguments)
+{
+    MessageDirectory directory(arguments.getOutputDirectory());
+
+    MessageDirectory::Verification result;
+    directory.verify(&result);
+
+    for (std::vector<std::string>::iterator path = result.damaged.begin(); path != result.damaged.end(); path++)
+    {
+        std::cout << "DAMAGED " << *path << std::endl;
+    }
+    for (std::vector<std::string>::iterator path = result.unchecked.begin(); path != result.unchecked.end(); path++)
+    {
+        std::cout << "UNCHECKED " << *path << std::endl;
+    }
+
+    std::cerr << "Verified " << result.verified << " message(s), " << result.damaged.size()
+              << " damaged, " << result.unchecked.size() << " without checksum." << std::endl;
+
+    return result.damaged.empty();
+}
+
 int main(int argc, char **argv)
 {
     CliArguments arguments;
@@ -128,6 +507,103 @@ int main(int argc, char **argv)
         usage(EXIT_FAILURE);
     }
 
+    /* The daemon and the batch mode take passwords from the accounts file. */
+    if (arguments.isDaemonSet())
+    {
+        try
+        {
+            Socket::setBackendType(arguments.getIoBackend());
+            Socket::setOptions(arguments.getSocketOptions());
+
+            AccountList accounts(arguments.getAccountsFile());
+            if (arguments.isBatchSet())
+            {
+                BatchRunner runner(accounts, arguments);
+                runner.run();
+                runner.printReport(std::cout);
+
+                return runner.getFailedCount() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+
+            Daemon daemon(accounts, arguments);
+            daemon.run();
+        }
+        catch (Error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (arguments.isQuerySet())
+    {
+        try
+        {
+            searchMessages(arguments);
+        }
+        catch (Error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (arguments.isVerifySet())
+    {
+        try
+        {
+            return verifyMessages(arguments) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        catch (Error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+#ifdef POP3_ZSTD
+    if (arguments.isExtractSet())
+    {
+        try
+        {
+            MessageArchive archive(arguments.getArchiveDirectory());
+            archive.extract(arguments.getExtractDigest(), fileno(stdout));
+        }
+        catch (Error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        return EXIT_SUCCESS;
+    }
+#else
+    if (arguments.isArchiveSet())
+    {
+        std::cerr << "Archives need zstd; build with make ZSTD=1." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+#endif
+
+    /* Bad rules are reported before asking for the password. */
+    std::unique_ptr<FilterRules> rules;
+    try
+    {
+        if (arguments.isFilterSet())
+        {
+            rules.reset(new FilterRules(arguments.getFilterFile()));
+        }
+    }
+    catch (Error& error)
+    {
+        std::cerr << error.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
     /* Get password. */
     std::string password;
     try
@@ -145,20 +621,64 @@ int main(int argc, char **argv)
     /* Process user's request. */
     try
     {
-        Pop3Session pop3(arguments.getHostname(), arguments.getPort());
+        Socket::setBackendType(arguments.getIoBackend());
+        Socket::setOptions(arguments.getSocketOptions());
+
+        ProfileCache profiles(arguments.getProfileCache());
+        ServerProfile profile = profiles.get(arguments.getHostname(), arguments.getPort());
+
+        Pop3Session pop3(arguments.getHostname(), arguments.getPort(), &profile);
         pop3.authenticate(arguments.getUsername(), password);
 
         password.clear(); // Remove password from memory
 
-        /* Either print the list of available messages or print
-           some specific message. */
-        if (arguments.isMessageIdSet())
+        /* Either store the messages, print the list of available
+           messages or print some specific message. */
+        if (arguments.isStoreDirectorySet())
         {
-            pop3.printMessage(arguments.getMessageId());
+            storeMessages(&pop3, arguments, rules.get());
+        }
+        else if (arguments.isOutputDirectorySet())
+        {
+            saveMessages(&pop3, arguments, rules.get());
+        }
+#ifdef POP3_ZSTD
+        else if (arguments.isArchiveSet())
+        {
+            archiveMessages(&pop3, arguments, rules.get());
+        }
+#endif
+        else if (arguments.isMessageIdSet() && arguments.isRawSet())
+        {
+            pop3.dumpMessage(arguments.getMessageId(), fileno(stdout));
+        }
+        else if (arguments.isMessageIdSet())
+        {
+            TerminalSink terminal;
+            if (arguments.isTranscodeSet())
+            {
+                TranscodingSink transcoder(&terminal);
+                pop3.retrieveMessage(arguments.getMessageId(), &transcoder);
+            }
+            else
+            {
+                pop3.retrieveMessage(arguments.getMessageId(), &terminal);
+            }
         }
         else
         {
-            pop3.printMessageList();
+            printMessageList(&pop3);
+        }
+
+        /* The next run starts from what this one learned. */
+        try
+        {
+            profiles.set(arguments.getHostname(), arguments.getPort(), profile);
+            profiles.save();
+        }
+        catch (ProfileCache::CacheError& error)
+        {
+            std::cerr << error.what() << std::endl;
         }
     }
     catch (Error& error)
@@ -0,0 +1,542 @@
+/**
+ * @brief Implementation of MessageArchive
+ *
+ * @file messagearchive.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "messagearchive.h"
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <zdict.h>
+
+namespace
+{
+    void makeDirectory(std::string const& path)
+    {
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            throw MessageArchive::StorageError("Unable to create directory", path);
+        }
+    }
+
+    void writeAll(int fileDescriptor, const char* data, size_t length, std::string const& path)
+    {
+        while (length > 0)
+        {
+            ssize_t bytesWritten = ::write(fileDescriptor, data, length);
+            if (bytesWritten < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw MessageArchive::StorageError("Unable to write file", path);
+            }
+
+            data   += bytesWritten;
+            length -= bytesWritten;
+        }
+    }
+
+    void synchronize(int fileDescriptor, std::string const& path)
+    {
+        if (fsync(fileDescriptor) != 0)
+        {
+            throw MessageArchive::StorageError("Unable to flush file to disk", path);
+        }
+    }
+
+    void synchronizeDirectory(std::string const& path)
+    {
+        int directoryDescriptor = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (directoryDescriptor < 0)
+        {
+            throw MessageArchive::StorageError("Unable to open directory", path);
+        }
+        synchronize(directoryDescriptor, path);
+        ::close(directoryDescriptor);
+    }
+
+    /* False when the file doesn't exist. */
+    bool readFile(std::string const& path, std::string* content)
+    {
+        int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+        {
+            if (errno == ENOENT)
+            {
+                return false;
+            }
+            throw MessageArchive::StorageError("Unable to open file", path);
+        }
+
+        content->clear();
+        char buffer[65536];
+        while (true)
+        {
+            ssize_t bytesRead = ::read(fileDescriptor, buffer, sizeof(buffer));
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytesRead < 0)
+            {
+                ::close(fileDescriptor);
+                throw MessageArchive::StorageError("Unable to read file", path);
+            }
+            if (bytesRead == 0)
+            {
+                break;
+            }
+            content->append(buffer, bytesRead);
+        }
+
+        ::close(fileDescriptor);
+        return true;
+    }
+}
+
+MessageArchive::MessageArchive(std::string const& directory)
+    : root(directory), dataPath(directory + "/messages.zst"), indexPath(directory + "/index"),
+      dictionaryPath(directory + "/dictionary"), dataFileDescriptor(-1), dataEnd(0),
+      compressor(NULL), dictionary(NULL), frameStart(0), messageSize(0), isTraining(false),
+      isStoredSampled(false),       storedCount(0), duplicateCount(0), storedBytes(0), compressedBytes(0)
+{
+    makeDirectory(root);
+
+    dataFileDescriptor = ::open(dataPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (dataFileDescriptor < 0)
+    {
+        throw StorageError("Unable to open file", dataPath);
+    }
+    synchronizeDirectory(root);
+
+    loadIndex();
+
+    /* Frames after the last indexed one were never committed. */
+    struct stat info;
+    if (fstat(dataFileDescriptor, &info) != 0 ||
+        (static_cast<uint64_t>(info.st_size) > dataEnd && ftruncate(dataFileDescriptor, dataEnd) != 0))
+    {
+        throw StorageError("Unable to truncate file", dataPath);
+    }
+
+    compressor = ZSTD_createCCtx();
+    if (compressor == NULL)
+    {
+        throw StorageError("Unable to initialize zstd", dataPath);
+    }
+    ZSTD_CCtx_setParameter(compressor, ZSTD_c_compressionLevel, COMPRESSION_LEVEL);
+    ZSTD_CCtx_setParameter(compressor, ZSTD_c_checksumFlag, 1);
+
+    std::string content;
+    if (readFile(dictionaryPath, &content))
+    {
+        loadDictionary(content.data(), content.length());
+    }
+    isTraining = dictionary == NULL;
+
+    output.resize(ZSTD_CStreamOutSize());
+}
+
+MessageArchive::~MessageArchive()
+{
+    ZSTD_freeCDict(dictionary);
+    ZSTD_freeCCtx(compressor);
+
+    if (dataFileDescriptor >= 0)
+    {
+        ::close(dataFileDescriptor);
+    }
+}
+
+void MessageArchive::begin(MessageInfo const& message)
+{
+    digest.reset();
+    messageUid  = message.uid;
+    messageSize = 0;
+    frameStart  = dataEnd;
+
+    /* Not in the constructor, -e doesn't train. */
+    if (isTraining && !isStoredSampled)
+    {
+        sampleStoredMessages();
+        if (sampleSizes.size() >= TRAINING_SAMPLES)
+        {
+            train();
+        }
+    }
+
+    ZSTD_CCtx_reset(compressor, ZSTD_reset_session_only);
+    ZSTD_CCtx_refCDict(compressor, dictionary);
+
+    if (isTraining)
+    {
+        sampleSizes.push_back(0);
+    }
+}
+
+void MessageArchive::write(const char* data, size_t length)
+{
+    digest.update(data, length);
+    messageSize += length;
+
+    if (isTraining && sampleSizes.back() < SAMPLE_SIZE)
+    {
+        size_t sampled = std::min(length, SAMPLE_SIZE - sampleSizes.back());
+        samples.append(data, sampled);
+        sampleSizes.back() += sampled;
+    }
+
+    compress(data, length, ZSTD_e_continue);
+}
+
+void MessageArchive::end()
+{
+    compress(NULL, 0, ZSTD_e_end);
+
+    std::string hexDigest = digest.hexDigest();
+    std::map<std::string, Entry>::const_iterator known = entries.find(hexDigest);
+    if (known != entries.end())
+    {
+        /* Known content -- the frame is taken back. */
+        if (ftruncate(dataFileDescriptor, frameStart) != 0)
+        {
+            throw StorageError("Unable to truncate file", dataPath);
+        }
+        dataEnd = frameStart;
+
+        if (isTraining)
+        {
+            samples.resize(samples.length() - sampleSizes.back());
+            sampleSizes.pop_back();
+        }
+
+        /* The uid is recorded all the same, so the next run
+           doesn't download the message again. */
+        if (!messageUid.empty() && uids.count(messageUid) == 0)
+        {
+            addRecord(hexDigest, known->second);
+        }
+
+        duplicateCount++;
+        return;
+    }
+
+    Entry entry;
+    entry.offset = frameStart;
+    entry.length = dataEnd - frameStart;
+    entry.size   = messageSize;
+    entries[hexDigest] = entry;
+    addRecord(hexDigest, entry);
+
+    storedCount++;
+    storedBytes     += entry.size;
+    compressedBytes += entry.length;
+
+    if (isTraining && sampleSizes.size() >= TRAINING_SAMPLES)
+    {
+        train();
+    }
+}
+
+void MessageArchive::addRecord(std::string const& hexDigest, Entry const& entry)
+{
+    std::stringstream record;
+    record << hexDigest << " " << entry.offset << " " << entry.length << " " << entry.size;
+    if (!messageUid.empty())
+    {
+        record << " " << messageUid;
+        uids.insert(messageUid);
+    }
+    record << "\n";
+
+    pendingRecords += record.str();
+}
+
+void MessageArchive::commit()
+{
+    if (pendingRecords.empty())
+    {
+        return;
+    }
+
+    /* The frames first, then the records that refer to them. */
+    synchronize(dataFileDescriptor, dataPath);
+
+    int index = ::open(indexPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (index < 0)
+    {
+        throw StorageError("Unable to open index", indexPath);
+    }
+
+    writeAll(index, pendingRecords.data(), pendingRecords.length(), indexPath);
+    synchronize(index, indexPath);
+    ::close(index);
+
+    pendingRecords.clear();
+}
+
+void MessageArchive::extract(std::string const& digestPrefix, int fileDescriptor) const
+{
+    std::map<std::string, Entry>::const_iterator entry = entries.lower_bound(digestPrefix);
+    if (entry == entries.end() || entry->first.compare(0, digestPrefix.length(), digestPrefix) != 0)
+    {
+        throw StorageError("No such message in the archive", digestPrefix);
+    }
+
+    std::map<std::string, Entry>::const_iterator next = entry;
+    if (++next != entries.end() && next->first.compare(0, digestPrefix.length(), digestPrefix) == 0)
+    {
+        throw StorageError("More messages match the digest", digestPrefix);
+    }
+
+    int input = ::open(dataPath.c_str(), O_RDONLY);
+    if (input < 0)
+    {
+        throw StorageError("Unable to open file", dataPath);
+    }
+
+    std::vector<char> frame(entry->second.length);
+    ssize_t bytesRead = pread(input, frame.data(), frame.size(), entry->second.offset);
+    ::close(input);
+
+    if (bytesRead != static_cast<ssize_t>(frame.size()))
+    {
+        throw StorageError("Unable to read file", dataPath);
+    }
+
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> decompressor(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    if (!decompressor)
+    {
+        throw StorageError("Unable to initialize zstd", dataPath);
+    }
+
+    std::string content;
+    if (ZSTD_getDictID_fromFrame(frame.data(), frame.size()) != 0 && readFile(dictionaryPath, &content))
+    {
+        ZSTD_DCtx_loadDictionary(decompressor.get(), content.data(), content.length());
+    }
+
+    std::vector<char> buffer(ZSTD_DStreamOutSize());
+    ZSTD_inBuffer compressed = {frame.data(), frame.size(), 0};
+
+    size_t remaining = 1;
+    while (remaining != 0)
+    {
+        ZSTD_outBuffer decompressed = {buffer.data(), buffer.size(), 0};
+        remaining = ZSTD_decompressStream(decompressor.get(), &decompressed, &compressed);
+        if (ZSTD_isError(remaining))
+        {
+            throw StorageError("Unable to decompress message", ZSTD_getErrorName(remaining));
+        }
+
+        writeAll(fileDescriptor, buffer.data(), decompressed.pos, "output");
+
+        if (remaining != 0 && compressed.pos == compressed.size && decompressed.pos < decompressed.size)
+        {
+            throw StorageError("Unable to decompress message", "Truncated frame");
+        }
+    }
+}
+
+void MessageArchive::loadIndex()
+{
+    std::string content;
+    if (!readFile(indexPath, &content))
+    {
+        return;
+    }
+
+    /* A record torn by a crash is dropped. */
+    size_t end = content.rfind('\n');
+    end = end == std::string::npos ? 0 : end + 1;
+    if (end < content.length())
+    {
+        if (truncate(indexPath.c_str(), end) != 0)
+        {
+            throw StorageError("Unable to truncate file", indexPath);
+        }
+        content.resize(end);
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        /* The uid is missing when the server lacks UIDL. */
+        std::istringstream fields(line);
+        std::string hexDigest;
+        std::string uid;
+        Entry entry;
+        if (!(fields >> hexDigest >> entry.offset >> entry.length >> entry.size))
+        {
+            continue;
+        }
+
+        entries[hexDigest] = entry;
+        dataEnd = std::max(dataEnd, entry.offset + entry.length);
+
+        if (fields >> uid)
+        {
+            uids.insert(uid);
+        }
+    }
+}
+
+void MessageArchive::loadDictionary(const char* data, size_t size)
+{
+    dictionary = ZSTD_createCDict(data, size, COMPRESSION_LEVEL);
+    if (dictionary == NULL)
+    {
+        throw StorageError("Unable to load dictionary", dictionaryPath);
+    }
+}
+
+void MessageArchive::sampleStoredMessages()
+{
+    isStoredSampled = true;
+    if (entries.empty())
+    {
+        return;
+    }
+
+    int input = ::open(dataPath.c_str(), O_RDONLY);
+    if (input < 0)
+    {
+        throw StorageError("Unable to open file", dataPath);
+    }
+
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> decompressor(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    if (!decompressor)
+    {
+        ::close(input);
+        throw StorageError("Unable to initialize zstd", dataPath);
+    }
+
+    std::vector<char> frame(ZSTD_DStreamInSize());
+    std::vector<char> sample(SAMPLE_SIZE);
+
+    for (std::map<std::string, Entry>::const_iterator entry = entries.begin();
+         entry != entries.end() && sampleSizes.size() < TRAINING_SAMPLES;
+         entry++)
+    {
+        ZSTD_DCtx_reset(decompressor.get(), ZSTD_reset_session_only);
+        ZSTD_outBuffer decompressed = {sample.data(), sample.size(), 0};
+
+        /* Only the beginning is needed; the frame is read in pieces
+           until it has been decompressed. */
+        uint64_t position = entry->second.offset;
+        uint64_t end      = entry->second.offset + entry->second.length;
+        bool isReadable   = true;
+        size_t remaining  = 1;
+        while (isReadable && remaining != 0 && position < end && decompressed.pos < decompressed.size)
+        {
+            size_t length = std::min<uint64_t>(frame.size(), end - position);
+            ssize_t bytesRead = pread(input, frame.data(), length, position);
+            if (bytesRead <= 0)
+            {
+                ::close(input);
+                throw StorageError("Unable to read file", dataPath);
+            }
+
+            /* Frames of a lost dictionary can't be read. */
+            if (position == entry->second.offset && ZSTD_getDictID_fromFrame(frame.data(), bytesRead) != 0)
+            {
+                isReadable = false;
+                break;
+            }
+            position += bytesRead;
+
+            ZSTD_inBuffer compressed = {frame.data(), static_cast<size_t>(bytesRead), 0};
+            while (remaining != 0 && compressed.pos < compressed.size && decompressed.pos < decompressed.size)
+            {
+                remaining = ZSTD_decompressStream(decompressor.get(), &decompressed, &compressed);
+                if (ZSTD_isError(remaining))
+                {
+                    isReadable = false;
+                    break;
+                }
+            }
+        }
+
+        if (isReadable && decompressed.pos > 0)
+        {
+            samples.append(sample.data(), decompressed.pos);
+            sampleSizes.push_back(decompressed.pos);
+        }
+    }
+
+    ::close(input);
+}
+
+void MessageArchive::train()
+{
+    isTraining = false;
+
+    std::vector<char> trained(DICTIONARY_SIZE);
+    size_t size = ZDICT_trainFromBuffer(trained.data(), trained.size(), samples.data(),
+                                        sampleSizes.data(), sampleSizes.size());
+
+    samples.clear();
+    samples.shrink_to_fit();
+    sampleSizes.clear();
+
+    if (ZDICT_isError(size))
+    {
+        return; /* Too little to learn from; the archive does without. */
+    }
+
+    /* The dictionary must be on the disk before any frame that needs it. */
+    std::string temporaryPath = dictionaryPath + ".tmp";
+    int fileDescriptor = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0)
+    {
+        throw StorageError("Unable to create file", temporaryPath);
+    }
+
+    writeAll(fileDescriptor, trained.data(), size, temporaryPath);
+    synchronize(fileDescriptor, temporaryPath);
+    ::close(fileDescriptor);
+
+    if (rename(temporaryPath.c_str(), dictionaryPath.c_str()) != 0)
+    {
+        throw StorageError("Unable to store dictionary", dictionaryPath);
+    }
+    synchronizeDirectory(root);
+
+    loadDictionary(trained.data(), size);
+}
+
+void MessageArchive::compress(const char* data, size_t length, ZSTD_EndDirective directive)
+{
+    ZSTD_inBuffer input = {data, length, 0};
+
+    bool isFinished = false;
+    while (!isFinished)
+    {
+        ZSTD_outBuffer compressed = {output.data(), output.size(), 0};
+        size_t remaining = ZSTD_compressStream2(compressor, &compressed, &input, directive);
+        if (ZSTD_isError(remaining))
+        {
+            throw StorageError("Unable to compress message", ZSTD_getErrorName(remaining));
+        }
+
+        writeAll(dataFileDescriptor, output.data(), compressed.pos, dataPath);
+        dataEnd += compressed.pos;
+
+        isFinished = directive == ZSTD_e_end ? remaining == 0 : input.pos == input.size;
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * @brief Compressed message archive
+ *
+ * @file messagearchive.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ *  Available only when built with ZSTD=1 (POP3_ZSTD defined).
+ */
+
+#ifndef _MESSAGEARCHIVE__H
+#define _MESSAGEARCHIVE__H
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <zstd.h>
+
+#include "error.h"
+#include "messagesink.h"
+#include "sha256.h"
+
+/**
+ * @brief Storage that compresses each message with zstd.
+ *
+ *  The archive of an account is a directory with these files:
+ *
+ *    <root>/messages.zst  one zstd frame per message
+ *    <root>/index         "<digest> <offset> <length> <size> [<uid>]"
+ *                         per frame, and per other uid of its content
+ *    <root>/dictionary    zstd dictionary (when it was trained)
+ *
+ *  Every message is a frame of its own, so it can be read without
+ *  the others. The messages are compressed as they stream in and
+ *  identified by the SHA-256 of their content; a message that is
+ *  already in the archive is dropped, but its unique id is recorded.
+ *  The unique ids let the next run skip the messages that are already
+ *  archived before they are downloaded (see getUniqueIds()).
+ *
+ *  Small messages share little within themselves, but a lot with
+ *  each other (headers, signatures, templates), which a dictionary
+ *  lets each of them use. The dictionary is trained once the archive
+ *  has TRAINING_SAMPLES messages; the messages stored before are
+ *  compressed without it. An account that gets only a few messages
+ *  a run gets one too: the beginnings of the stored messages are
+ *  decompressed for the samples. The frames record the id of their
+ *  dictionary.
+ *
+ *  Frames become visible in commit(), when the data file was
+ *  fsync'ed and the records appended to the index. Data after the
+ *  last indexed frame (from a crash) are dropped when the archive
+ *  is opened again.
+ */
+class MessageArchive : public MessageSink
+{
+    static const int COMPRESSION_LEVEL     = 9;
+    static const size_t DICTIONARY_SIZE    = 112 * 1024;
+    static const size_t TRAINING_SAMPLES   = 128;
+    static const size_t SAMPLE_SIZE        = 16 * 1024; /*< Beginning of a message */
+
+    struct Entry
+    {
+        uint64_t offset;
+        uint64_t length; /*< Of the frame */
+        uint64_t size;   /*< Of the message */
+    };
+
+    std::string root;
+    std::string dataPath;
+    std::string indexPath;
+    std::string dictionaryPath;
+
+    int dataFileDescriptor;
+    uint64_t dataEnd;
+    std::map<std::string, Entry> entries;
+    std::set<std::string> uids;
+
+    ZSTD_CCtx* compressor;
+    ZSTD_CDict* dictionary;
+    std::vector<char> output;
+
+    Sha256 digest;
+    std::string messageUid;
+    uint64_t frameStart;
+    size_t messageSize;
+
+    /* Training data, while there is no dictionary */
+    std::string samples;
+    std::vector<size_t> sampleSizes;
+    bool isTraining;
+    bool isStoredSampled; /*< The stored messages are among the samples */
+
+    std::string pendingRecords;
+
+    unsigned storedCount;
+    unsigned duplicateCount;
+    uint64_t storedBytes;
+    uint64_t compressedBytes;
+
+    public:
+        /**
+         * @param[in] directory Directory of the archive. It is created
+         *                      when it doesn't exist.
+         */
+        MessageArchive(std::string const& directory);
+        ~MessageArchive();
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+        void commit();
+
+        /**
+         * @brief Decompress a message.
+         *
+         * @param[in] digestPrefix SHA-256 of the message, or enough
+         *                         of its beginning to be unique.
+         * @param[in] fileDescriptor Where to write the message.
+         * @return void
+         */
+        void extract(std::string const& digestPrefix, int fileDescriptor) const;
+
+        /**
+         * @brief Unique ids (from UIDL) of the archived messages.
+         *
+         *  The messages that were dropped as duplicates are
+         *  included.
+         */
+        std::set<std::string> const& getUniqueIds() const { return uids; }
+
+        /* Statistics */
+        unsigned getStoredCount() const { return storedCount; }
+        unsigned getDuplicateCount() const { return duplicateCount; }
+        uint64_t getStoredBytes() const { return storedBytes; }
+        uint64_t getCompressedBytes() const { return compressedBytes; }
+
+        /* Exceptions */
+        class StorageError;
+
+    private:
+        void loadIndex();
+        void addRecord(std::string const& hexDigest, Entry const& entry);
+        void loadDictionary(const char* data, size_t size);
+        void sampleStoredMessages();
+        void train();
+
+        void compress(const char* data, size_t length, ZSTD_EndDirective directive);
+};
+
+/**
+ * @brief Indicates failure of the archive.
+ *
+ *  Thrown when a file of the archive can't be read or written,
+ *  or when zstd fails.
+ */
+class MessageArchive::StorageError : public Error
+{
+    public:
+        StorageError(std::string const& issue, std::string const& path)
+        {
+            problem = issue;
+            reason  = path;
+        }
+};
+
+#endif
@@ -0,0 +1,394 @@
+/**
+ * @brief Implementation of MessageDirectory
+ *
+ * @file messagedirectory.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "messagedirectory.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <sstream>
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+
+namespace
+{
+    std::string getFileName(std::string const& path)
+    {
+        return path.substr(path.rfind('/') + 1);
+    }
+}
+
+const char* const MessageDirectory::CHECKSUMS_NAME = "checksums";
+
+MessageDirectory::MessageDirectory(std::string const& path)
+    : directory(path), fileDescriptor(-1), expectedSize(0), receivedSize(0), checksumsDescriptor(-1),
+      outputBuffer(OUTPUT_BUFFER_SIZE), buffered(0), synchronous(false)
+{
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw StorageError("Unable to create directory", directory);
+    }
+}
+
+MessageDirectory::~MessageDirectory()
+{
+    abort();
+
+    for (std::vector<PendingFile>::iterator file = pending.begin(); file != pending.end(); file++)
+    {
+        ::close(file->fileDescriptor);
+    }
+
+    if (checksumsDescriptor >= 0)
+    {
+        ::close(checksumsDescriptor);
+    }
+}
+
+std::string MessageDirectory::getPath(MessageInfo const& message) const
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    std::stringstream name;
+    name << directory << "/";
+
+    if (message.uid.empty())
+    {
+        name << message.id;
+    }
+    else
+    {
+        /* Unique ids may contain any printable character,
+           so escape the ones that are unsafe in file names. */
+        for (size_t i = 0; i < message.uid.length(); i++)
+        {
+            unsigned char c = message.uid[i];
+            if (isalnum(c) || c == '-' || c == '_' || c == '+' || c == '=' || (c == '.' && i > 0))
+            {
+                name << c;
+            }
+            else
+            {
+                name << '%' << hexDigits[c >> 4] << hexDigits[c & 0x0f];
+            }
+        }
+    }
+
+    name << ".eml";
+    return name.str();
+}
+
+bool MessageDirectory::isStored(MessageInfo const& message, size_t size) const
+{
+    struct stat info;
+    if (stat(getPath(message).c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    return static_cast<size_t>(info.st_size) == size;
+}
+
+void MessageDirectory::begin(MessageInfo const& message)
+{
+    abort();
+
+    finalPath = getPath(message);
+    partPath  = finalPath + ".part";
+
+    fileDescriptor = ::open(partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0)
+    {
+        throw StorageError("Unable to create file", partPath);
+    }
+
+    /* Only a hint -- the size from LIST may be off a little and
+       not every filesystem supports this, so errors are ignored.
+       The file size itself isn't changed. */
+    if (message.size > 0)
+    {
+        fallocate(fileDescriptor, FALLOC_FL_KEEP_SIZE, 0, message.size);
+    }
+
+    buffered = 0;
+    expectedSize = message.size;
+    receivedSize = 0;
+    checksum.reset();
+}
+
+void MessageDirectory::write(const char* data, size_t length)
+{
+    if (buffered + length > outputBuffer.size())
+    {
+        flush();
+    }
+
+    if (length >= outputBuffer.size())
+    {
+        /* Too big to be buffered, write it right away. */
+        writeOut(data, length);
+        return;
+    }
+
+    memcpy(&outputBuffer[buffered], data, length);
+    buffered += length;
+}
+
+void MessageDirectory::end()
+{
+    flush();
+
+    if (expectedSize > 0 && receivedSize != expectedSize)
+    {
+        SizeMismatch mismatch;
+        mismatch.path     = finalPath;
+        mismatch.expected = expectedSize;
+        mismatch.received = receivedSize;
+        sizeMismatches.push_back(mismatch);
+    }
+
+    char line[32];
+    snprintf(line, sizeof(line), "%08x %zu ", checksum.getValue(), receivedSize);
+    pendingChecksums += line;
+    pendingChecksums += getFileName(finalPath);
+    pendingChecksums += '\n';
+
+    if (synchronous)
+    {
+        PendingFile file;
+        file.fileDescriptor = fileDescriptor;
+        file.partPath       = partPath;
+        file.finalPath      = finalPath;
+        pending.push_back(file);
+
+        fileDescriptor = -1;
+        return;
+    }
+
+    ::close(fileDescriptor);
+    fileDescriptor = -1;
+
+    if (rename(partPath.c_str(), finalPath.c_str()) != 0)
+    {
+        throw StorageError("Unable to store message", finalPath);
+    }
+
+    writeChecksums();
+}
+
+void MessageDirectory::commit()
+{
+    if (pending.empty())
+    {
+        return;
+    }
+
+    /* Data first, ... */
+    for (std::vector<PendingFile>::iterator file = pending.begin(); file != pending.end(); file++)
+    {
+        synchronize(file->fileDescriptor, file->partPath);
+    }
+
+    /* ... then the names. */
+    while (!pending.empty())
+    {
+        PendingFile& file = pending.back();
+
+        ::close(file.fileDescriptor);
+        if (rename(file.partPath.c_str(), file.finalPath.c_str()) != 0)
+        {
+            throw StorageError("Unable to store message", file.finalPath);
+        }
+        pending.pop_back();
+    }
+
+    int directoryDescriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directoryDescriptor < 0)
+    {
+        throw StorageError("Unable to open directory", directory);
+    }
+    synchronize(directoryDescriptor, directory);
+    ::close(directoryDescriptor);
+
+    /* A crash before this leaves the messages unchecked, never
+       with a wrong checksum. */
+    writeChecksums();
+    synchronize(checksumsDescriptor, directory + "/" + CHECKSUMS_NAME);
+}
+
+void MessageDirectory::verify(Verification* result) const
+{
+    std::string checksumsPath = directory + "/" + CHECKSUMS_NAME;
+
+    /* File name -> checksum and size, the last line wins */
+    std::map<std::string, std::pair<uint32_t, size_t> > expected;
+
+    std::ifstream checksums(checksumsPath.c_str());
+    std::string line;
+    while (std::getline(checksums, line))
+    {
+        unsigned value;
+        size_t size;
+        char name[256];
+        if (sscanf(line.c_str(), "%8x %zu %255s", &value, &size, name) == 3)
+        {
+            expected[name] = std::make_pair(static_cast<uint32_t>(value), size);
+        }
+    }
+
+    std::vector<char> buffer(OUTPUT_BUFFER_SIZE);
+    for (std::map<std::string, std::pair<uint32_t, size_t> >::iterator file = expected.begin();
+         file != expected.end();
+         file++)
+    {
+        std::string path = directory + "/" + file->first;
+
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            result->damaged.push_back(path);
+            continue;
+        }
+
+        Crc32c computed;
+        size_t size = 0;
+        ssize_t length;
+        while ((length = ::read(descriptor, &buffer[0], buffer.size())) != 0)
+        {
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (length < 0)
+            {
+                ::close(descriptor);
+                throw StorageError("Unable to read file", path);
+            }
+
+            computed.update(&buffer[0], length);
+            size += length;
+        }
+        ::close(descriptor);
+
+        if (size == file->second.second && computed.getValue() == file->second.first)
+        {
+            result->verified++;
+        }
+        else
+        {
+            result->damaged.push_back(path);
+        }
+    }
+
+    DIR* listing = opendir(directory.c_str());
+    if (listing == NULL)
+    {
+        throw StorageError("Unable to open directory", directory);
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(listing)) != NULL)
+    {
+        std::string name(entry->d_name);
+        if (name.length() > 4 && name.compare(name.length() - 4, 4, ".eml") == 0 &&
+            expected.find(name) == expected.end())
+        {
+            result->unchecked.push_back(directory + "/" + name);
+        }
+    }
+    closedir(listing);
+
+    std::sort(result->unchecked.begin(), result->unchecked.end());
+}
+
+void MessageDirectory::synchronize(int descriptor, std::string const& path)
+{
+    if (fsync(descriptor) != 0)
+    {
+        throw StorageError("Unable to flush file to disk", path);
+    }
+}
+
+void MessageDirectory::flush()
+{
+    writeOut(&outputBuffer[0], buffered);
+    buffered = 0;
+}
+
+void MessageDirectory::writeOut(const char* data, size_t length)
+{
+    /* The data are still in the cache, so this is nearly free. */
+    checksum.update(data, length);
+    receivedSize += length;
+
+    while (length > 0)
+    {
+        ssize_t written = ::write(fileDescriptor, data, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            throw StorageError("Unable to write file", partPath);
+        }
+        data   += written;
+        length -= written;
+    }
+}
+
+void MessageDirectory::writeChecksums()
+{
+    if (checksumsDescriptor < 0)
+    {
+        std::string path = directory + "/" + CHECKSUMS_NAME;
+        checksumsDescriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (checksumsDescriptor < 0)
+        {
+            throw StorageError("Unable to open file", path);
+        }
+    }
+
+    const char* data = pendingChecksums.data();
+    size_t length = pendingChecksums.length();
+    while (length > 0)
+    {
+        ssize_t count = ::write(checksumsDescriptor, data, length);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            throw StorageError("Unable to write file", directory + "/" + CHECKSUMS_NAME);
+        }
+        data   += count;
+        length -= count;
+    }
+
+    pendingChecksums.clear();
+}
+
+void MessageDirectory::abort()
+{
+    /* Unfinished messages stay as .part */
+    if (fileDescriptor >= 0)
+    {
+        ::close(fileDescriptor);
+        fileDescriptor = -1;
+    }
+}
@@ -0,0 +1,184 @@
+/**
+ * @brief Directory of message files
+ *
+ * @file messagedirectory.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _MESSAGEDIRECTORY__H
+#define _MESSAGEDIRECTORY__H
+
+#include <string>
+#include <vector>
+
+#include "crc32c.h"
+#include "error.h"
+#include "messagesink.h"
+
+/**
+ * @brief Stores each message into its own file.
+ *
+ *  Message is saved as <directory>/<uid>.eml, or <id>.eml when the
+ *  unique id is unknown. While it's being received, it's written
+ *  to <name>.eml.part, which is renamed when the message is
+ *  complete, so a finished file is never confused with a partial
+ *  one.
+ *
+ *  When the expected size is known, the file is preallocated with
+ *  fallocate() so large messages don't fragment, and the data are
+ *  written in big chunks through an output buffer.
+ *
+ *  In synchronous mode the finished messages are renamed only by
+ *  commit(), after they were fsync'ed all together. The directory
+ *  is then fsync'ed once for the whole group.
+ *
+ *  The CRC-32C of each message is computed from the output buffer
+ *  right before it's written out, and appended to the file
+ *  <directory>/checksums once the message is stored, as a line of
+ *  "<crc32c> <size> <file name>". verify() checks the stored files
+ *  against it later. A message whose size doesn't match the one
+ *  reported by the server is recorded as a size mismatch at once.
+ */
+class MessageDirectory : public MessageSink
+{
+    public:
+        static const char* const CHECKSUMS_NAME;
+
+        /**
+         * @brief A message that differs in size from the server's report.
+         */
+        struct SizeMismatch
+        {
+            std::string path;
+            size_t expected;  /*< Size reported by the server */
+            size_t received;  /*< Size actually received */
+        };
+
+        /**
+         * @brief Outcome of verify().
+         */
+        struct Verification
+        {
+            size_t verified;                    /*< Files that match their checksums */
+            std::vector<std::string> damaged;   /*< Missing, truncated or corrupted files */
+            std::vector<std::string> unchecked; /*< Files without a checksum */
+
+            Verification() : verified(0) {}
+        };
+
+    private:
+        static const size_t OUTPUT_BUFFER_SIZE = 256 * 1024;
+
+        std::string directory;
+
+        int fileDescriptor;
+        std::string partPath;
+        std::string finalPath;
+        size_t expectedSize;
+
+        Crc32c checksum;
+        size_t receivedSize;
+
+        /* Checksum lines of stored messages not yet in the checksums file */
+        std::string pendingChecksums;
+        int checksumsDescriptor;
+
+        std::vector<SizeMismatch> sizeMismatches;
+
+        std::vector<char> outputBuffer;
+        size_t buffered;
+
+        bool synchronous;
+
+        /* Finished messages waiting for commit() */
+        struct PendingFile
+        {
+            int fileDescriptor;
+            std::string partPath;
+            std::string finalPath;
+        };
+        std::vector<PendingFile> pending;
+
+    public:
+        /**
+         * @param[in] path Directory for the messages. It is created
+         *                 when it doesn't exist.
+         */
+        MessageDirectory(std::string const& path);
+        ~MessageDirectory();
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+        void commit();
+
+        /**
+         * @brief Make finished messages durable.
+         *
+         *  When enabled, messages are flushed to the disk with
+         *  fsync() and renamed to their final names in commit().
+         *  Otherwise they are renamed right in end().
+         *
+         * @param[in] enabled Turn it on or off (default).
+         * @return void
+         */
+        void setSynchronous(bool enabled) { synchronous = enabled; }
+
+        /**
+         * @brief Path of the file a message is saved to.
+         */
+        std::string getPath(MessageInfo const& message) const;
+
+        /**
+         * @brief Check that a message was saved completely.
+         *
+         * @param[in] message The message.
+         * @param[in] size Number of bytes that were written.
+         * @return True when the file exists and has \c size bytes.
+         */
+        bool isStored(MessageInfo const& message, size_t size) const;
+
+        /**
+         * @brief Messages received since the directory was opened whose
+         *        size differs from the one reported by the server.
+         */
+        std::vector<SizeMismatch> const& getSizeMismatches() const { return sizeMismatches; }
+
+        /**
+         * @brief Check the stored messages against their checksums.
+         *
+         *  Each file listed in the checksums file is read back and its
+         *  size and CRC-32C compared. The last line of a file counts
+         *  when it was downloaded more than once.
+         *
+         * @param[out] result What was found.
+         * @return void
+         */
+        void verify(Verification* result) const;
+
+        /* Exceptions */
+        class StorageError;
+
+    private:
+        void flush();
+        void synchronize(int descriptor, std::string const& path);
+        void writeOut(const char* data, size_t length);
+        void writeChecksums();
+        void abort();
+};
+
+/**
+ * @brief Indicates failure of the underlying filesystem.
+ */
+class MessageDirectory::StorageError : public Error
+{
+    public:
+        StorageError(std::string const& issue, std::string const& path)
+        {
+            problem = issue;
+            reason  = path;
+        }
+};
+
+#endif
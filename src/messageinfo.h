@@ -0,0 +1,29 @@
+/**
+ * @brief Description of a message on the server
+ *
+ * @file messageinfo.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _MESSAGEINFO__H
+#define _MESSAGEINFO__H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Entry of the message list.
+ */
+struct MessageInfo
+{
+    int id;
+    size_t size;     /*< Size in octets as reported by LIST, 0 if unknown. */
+    std::string uid; /*< Unique id from UIDL, empty if unknown. */
+
+    MessageInfo(int messageId = 0, size_t messageSize = 0)
+        : id(messageId), size(messageSize)
+    {}
+};
+
+#endif
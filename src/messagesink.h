@@ -0,0 +1,70 @@
+/**
+ * @brief Destination for retrieved messages
+ *
+ * @file messagesink.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _MESSAGESINK__H
+#define _MESSAGESINK__H
+
+#include <cstddef>
+
+#include "messageinfo.h"
+
+/**
+ * @brief Receiver of message data streamed from the server.
+ *
+ *  Pop3Session pushes the message into a sink as it arrives
+ *  instead of collecting it in memory first. The data are
+ *  already un-stuffed and each line is terminated by \\r\\n,
+ *  i.e. the sink sees the message exactly as it is stored
+ *  on the server.
+ */
+class MessageSink
+{
+    public:
+        virtual ~MessageSink() {}
+
+        /**
+         * @brief Start of a new message.
+         *
+         *  The size in \c message is the one reported by the server
+         *  (0 when unknown). It's only a hint for preallocation.
+         *
+         * @param[in] message The message that follows.
+         * @return void
+         */
+        virtual void begin(MessageInfo const& message) {}
+
+        /**
+         * @brief Next chunk of the message.
+         *
+         * @param[in] data Message data.
+         * @param[in] length Number of bytes in \c data.
+         * @return void
+         */
+        virtual void write(const char* data, size_t length) = 0;
+
+        /**
+         * @brief The message was transferred completely.
+         *
+         * @return void
+         */
+        virtual void end() {}
+
+        /**
+         * @brief Make all the finished messages durable.
+         *
+         *  Sinks that write to a disk flush the messages that were
+         *  ended since the last commit in a single group. Once this
+         *  returns, the messages survive a crash -- the caller may
+         *  e.g. delete them from the server.
+         *
+         * @return void
+         */
+        virtual void commit() {}
+};
+
+#endif
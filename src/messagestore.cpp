@@ -0,0 +1,269 @@
+/**
+ * @brief Implementation of MessageStore
+ *
+ * @file messagestore.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "messagestore.h"
+
+#include <algorithm>
+#include <string>
+#include <sstream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+namespace
+{
+    void makeDirectory(std::string const& path)
+    {
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            throw MessageStore::StorageError("Unable to create directory", path);
+        }
+    }
+
+    void writeAll(int fileDescriptor, const char* data, size_t length, std::string const& path)
+    {
+        while (length > 0)
+        {
+            ssize_t bytesWritten = ::write(fileDescriptor, data, length);
+            if (bytesWritten < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw MessageStore::StorageError("Unable to write file", path);
+            }
+
+            data   += bytesWritten;
+            length -= bytesWritten;
+        }
+    }
+
+    void synchronize(int fileDescriptor, std::string const& path)
+    {
+        if (fsync(fileDescriptor) != 0)
+        {
+            throw MessageStore::StorageError("Unable to flush file to disk", path);
+        }
+    }
+
+    bool fileExists(std::string const& path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0;
+    }
+}
+
+MessageStore::MessageStore(std::string const& directory, std::string const& account)
+    : root(directory), spillFileDescriptor(-1), messageId(0), messageSize(0),
+      storedCount(0), duplicateCount(0)
+{
+    makeDirectory(root);
+    makeDirectory(root + "/blobs");
+    makeDirectory(root + "/manifests");
+    makeDirectory(root + "/tmp");
+
+    /* The account name becomes a file name. */
+    std::string manifestName = account;
+    for (std::string::iterator c = manifestName.begin(); c != manifestName.end(); c++)
+    {
+        if (*c == '/')
+        {
+            *c = '_';
+        }
+    }
+    manifestPath = root + "/manifests/" + manifestName;
+}
+
+MessageStore::~MessageStore()
+{
+    discardSpill();
+
+    /* Uncommitted blobs are thrown away. */
+    for (std::vector<PendingBlob>::iterator blob = pendingBlobs.begin(); blob != pendingBlobs.end(); blob++)
+    {
+        ::close(blob->fileDescriptor);
+        unlink(blob->temporaryPath.c_str());
+    }
+}
+
+void MessageStore::begin(MessageInfo const& message)
+{
+    discardSpill();
+
+    digest.reset();
+    pending.clear();
+    pending.reserve(std::min(message.size, SPILL_THRESHOLD + 1));
+    messageId   = message.id;
+    messageKey  = message.uid.empty() ? std::to_string(message.id) : message.uid;
+    messageSize = 0;
+}
+
+void MessageStore::write(const char* data, size_t length)
+{
+    digest.update(data, length);
+    messageSize += length;
+
+    if (spillFileDescriptor >= 0)
+    {
+        writeAll(spillFileDescriptor, data, length, spillPath);
+        return;
+    }
+
+    pending.append(data, length);
+    if (pending.length() > SPILL_THRESHOLD)
+    {
+        spill();
+    }
+}
+
+void MessageStore::end()
+{
+    std::string hexDigest = digest.hexDigest();
+
+    if (contains(hexDigest))
+    {
+        /* Known content -- nothing to write. */
+        discardSpill();
+        duplicateCount++;
+    }
+    else
+    {
+        if (spillFileDescriptor < 0)
+        {
+            spill();
+        }
+
+        PendingBlob blob;
+        blob.fileDescriptor = spillFileDescriptor;
+        blob.temporaryPath  = spillPath;
+        blob.hexDigest      = hexDigest;
+        pendingBlobs.push_back(blob);
+
+        spillFileDescriptor = -1;
+        storedCount++;
+    }
+
+    pending.clear();
+
+    std::stringstream record;
+    record << messageKey << " " << hexDigest << " " << messageSize << "\n";
+    pendingRecords += record.str();
+}
+
+void MessageStore::commit()
+{
+    std::vector<std::string> directories;
+
+    /* Blob content first, ... */
+    for (std::vector<PendingBlob>::iterator blob = pendingBlobs.begin(); blob != pendingBlobs.end(); blob++)
+    {
+        synchronize(blob->fileDescriptor, blob->temporaryPath);
+    }
+
+    /* ... then their names, ... */
+    while (!pendingBlobs.empty())
+    {
+        PendingBlob& blob = pendingBlobs.back();
+        std::string directory = root + "/blobs/" + blob.hexDigest.substr(0, 2);
+        std::string blobPath  = getBlobPath(blob.hexDigest);
+
+        makeDirectory(directory);
+        directories.push_back(directory);
+
+        ::close(blob.fileDescriptor);
+        if (rename(blob.temporaryPath.c_str(), blobPath.c_str()) != 0)
+        {
+            throw StorageError("Unable to store message", blobPath);
+        }
+        pendingBlobs.pop_back();
+    }
+
+    std::sort(directories.begin(), directories.end());
+    directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+    directories.push_back(root + "/blobs");
+    for (std::vector<std::string>::iterator directory = directories.begin(); directory != directories.end(); directory++)
+    {
+        int directoryDescriptor = ::open(directory->c_str(), O_RDONLY | O_DIRECTORY);
+        if (directoryDescriptor < 0)
+        {
+            throw StorageError("Unable to open directory", *directory);
+        }
+        synchronize(directoryDescriptor, *directory);
+        ::close(directoryDescriptor);
+    }
+
+    /* ... and the manifest that refers to them. */
+    if (!pendingRecords.empty())
+    {
+        int manifest = ::open(manifestPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (manifest < 0)
+        {
+            throw StorageError("Unable to open manifest", manifestPath);
+        }
+
+        writeAll(manifest, pendingRecords.data(), pendingRecords.length(), manifestPath);
+        synchronize(manifest, manifestPath);
+        ::close(manifest);
+
+        pendingRecords.clear();
+    }
+}
+
+bool MessageStore::contains(std::string const& hexDigest) const
+{
+    return isPending(hexDigest) || fileExists(getBlobPath(hexDigest));
+}
+
+bool MessageStore::isPending(std::string const& hexDigest) const
+{
+    for (std::vector<PendingBlob>::const_iterator blob = pendingBlobs.begin(); blob != pendingBlobs.end(); blob++)
+    {
+        if (blob->hexDigest == hexDigest)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string MessageStore::getBlobPath(std::string const& hexDigest) const
+{
+    return root + "/blobs/" + hexDigest.substr(0, 2) + "/" + hexDigest;
+}
+
+void MessageStore::spill()
+{
+    std::stringstream path;
+    path << root << "/tmp/" << getpid() << "." << messageId;
+    spillPath = path.str();
+
+    spillFileDescriptor = ::open(spillPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (spillFileDescriptor < 0)
+    {
+        throw StorageError("Unable to create file", spillPath);
+    }
+
+    writeAll(spillFileDescriptor, pending.data(), pending.length(), spillPath);
+    pending.clear();
+}
+
+void MessageStore::discardSpill()
+{
+    if (spillFileDescriptor >= 0)
+    {
+        ::close(spillFileDescriptor);
+        unlink(spillPath.c_str());
+        spillFileDescriptor = -1;
+    }
+}
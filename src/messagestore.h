@@ -0,0 +1,127 @@
+/**
+ * @brief Content-addressed message store
+ *
+ * @file messagestore.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _MESSAGESTORE__H
+#define _MESSAGESTORE__H
+
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "messagesink.h"
+#include "sha256.h"
+
+/**
+ * @brief Deduplicating storage for retrieved messages.
+ *
+ *  Messages are stored by the SHA-256 of their content, so
+ *  a message that landed in many mailboxes occupies the disk
+ *  only once. The store has the following layout:
+ *
+ *    <root>/blobs/ab/abcdef...   message content
+ *    <root>/manifests/<account>  "<uid> <digest> <size>" per line
+ *    <root>/tmp/                 partially received messages
+ *
+ *  The digest is computed while the message streams in. Messages
+ *  up to SPILL_THRESHOLD bytes are kept in memory until the digest
+ *  is known, so content that is already in the store never touches
+ *  the disk. Larger messages are spilled to a temporary file that
+ *  is either renamed into place or discarded.
+ *
+ *  Message ids are valid only within a session, so the records of
+ *  the manifest name the messages by their unique ids from UIDL;
+ *  the message id is recorded only when the server has no UIDL.
+ *
+ *  New blobs and manifest records become visible in commit(), once
+ *  they were fsync'ed. A blob therefore always has the content its
+ *  name promises, even after a crash.
+ */
+class MessageStore : public MessageSink
+{
+    static const size_t SPILL_THRESHOLD = 1024 * 1024;
+
+    std::string root;
+    std::string manifestPath;
+
+    Sha256 digest;
+    std::string pending;
+    int spillFileDescriptor;
+    std::string spillPath;
+
+    int messageId;
+    std::string messageKey; /*< Unique id, or the message id */
+    size_t messageSize;
+
+    unsigned storedCount;
+    unsigned duplicateCount;
+
+    /* Finished messages waiting for commit() */
+    struct PendingBlob
+    {
+        int fileDescriptor;
+        std::string temporaryPath;
+        std::string hexDigest;
+    };
+    std::vector<PendingBlob> pendingBlobs;
+    std::string pendingRecords;
+
+    public:
+        /**
+         * @param[in] directory Root directory of the store. It is
+         *                      created when it doesn't exist.
+         * @param[in] account Name of the manifest the messages are
+         *                    recorded in (e.g. user@host).
+         */
+        MessageStore(std::string const& directory, std::string const& account);
+        ~MessageStore();
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+        void commit();
+
+        /**
+         * @brief Check whether a content is already stored.
+         *
+         * @param[in] hexDigest SHA-256 of the content.
+         * @return True when the blob exists or waits for commit().
+         */
+        bool contains(std::string const& hexDigest) const;
+
+        /* Statistics */
+        unsigned getStoredCount() const { return storedCount; }
+        unsigned getDuplicateCount() const { return duplicateCount; }
+
+        /* Exceptions */
+        class StorageError;
+
+    private:
+        std::string getBlobPath(std::string const& hexDigest) const;
+
+        void spill();
+        void discardSpill();
+        bool isPending(std::string const& hexDigest) const;
+};
+
+/**
+ * @brief Indicates failure of the underlying filesystem.
+ *
+ *  Thrown when a directory or file of the store can't be
+ *  created or written.
+ */
+class MessageStore::StorageError : public Error
+{
+    public:
+        StorageError(std::string const& issue, std::string const& path)
+        {
+            problem = issue;
+            reason  = path;
+        }
+};
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * @brief Implementation of MimeCodec
+ *
+ * @file mimecodec.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "mimecodec.h"
+
+#include <strings.h>
+
+namespace
+{
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    int base64Value(char c)
+    {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    }
+
+    bool startsWith(std::string_view text, std::string_view prefix)
+    {
+        return text.length() >= prefix.length() &&
+               strncasecmp(text.data(), prefix.data(), prefix.length()) == 0;
+    }
+
+    std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+}
+
+void MimeCodec::decodeQuotedPrintable(std::string_view text, bool isHeader, std::string* output)
+{
+    output->clear();
+
+    for (size_t i = 0; i < text.length(); i++)
+    {
+        if (text[i] == '=' && i + 2 < text.length() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0)
+        {
+            *output += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+            i += 2;
+        }
+        else if (text[i] == '=' && i + 1 == text.length())
+        {
+            break; /* Soft line break */
+        }
+        else if (isHeader && text[i] == '_')
+        {
+            *output += ' ';
+        }
+        else
+        {
+            *output += text[i];
+        }
+    }
+}
+
+void MimeCodec::decodeBase64(std::string_view text, std::string* carry, std::string* output)
+{
+    output->clear();
+
+    for (size_t i = 0; i < text.length(); i++)
+    {
+        if (text[i] == '=') /* Padding ends the group. */
+        {
+            if (carry->length() >= 2)
+            {
+                unsigned group = base64Value((*carry)[0]) << 18 | base64Value((*carry)[1]) << 12;
+                if (carry->length() == 3)
+                {
+                    group |= base64Value((*carry)[2]) << 6;
+                }
+
+                *output += static_cast<char>(group >> 16);
+                if (carry->length() == 3)
+                {
+                    *output += static_cast<char>(group >> 8);
+                }
+            }
+            carry->clear();
+            continue;
+        }
+
+        if (base64Value(text[i]) < 0)
+        {
+            continue;
+        }
+
+        *carry += text[i];
+        if (carry->length() == 4)
+        {
+            unsigned group = base64Value((*carry)[0]) << 18 | base64Value((*carry)[1]) << 12 |
+                             base64Value((*carry)[2]) << 6  | base64Value((*carry)[3]);
+
+            *output += static_cast<char>(group >> 16);
+            *output += static_cast<char>(group >> 8);
+            *output += static_cast<char>(group);
+            carry->clear();
+        }
+    }
+}
+
+void MimeCodec::encodeBase64(std::string_view data, std::string* output)
+{
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    size_t i = 0;
+    for (; i + 3 <= data.length(); i += 3)
+    {
+        unsigned group = static_cast<unsigned char>(data[i]) << 16 |
+                         static_cast<unsigned char>(data[i + 1]) << 8 |
+                         static_cast<unsigned char>(data[i + 2]);
+
+        *output += ALPHABET[group >> 18];
+        *output += ALPHABET[group >> 12 & 0x3f];
+        *output += ALPHABET[group >> 6 & 0x3f];
+        *output += ALPHABET[group & 0x3f];
+    }
+
+    if (i < data.length())
+    {
+        unsigned group = static_cast<unsigned char>(data[i]) << 16;
+        if (i + 1 < data.length())
+        {
+            group |= static_cast<unsigned char>(data[i + 1]) << 8;
+        }
+
+        *output += ALPHABET[group >> 18];
+        *output += ALPHABET[group >> 12 & 0x3f];
+        *output += i + 1 < data.length() ? ALPHABET[group >> 6 & 0x3f] : '=';
+        *output += '=';
+    }
+}
+
+std::string MimeCodec::getParameter(std::string const& value, std::string const& name)
+{
+    size_t position = 0;
+    while ((position = value.find(';', position)) != std::string::npos)
+    {
+        std::string_view parameter = trim(std::string_view(value).substr(position + 1));
+        position++;
+
+        if (!startsWith(parameter, name) || parameter.length() <= name.length() ||
+            parameter[name.length()] != '=')
+        {
+            continue;
+        }
+
+        parameter.remove_prefix(name.length() + 1);
+        if (!parameter.empty() && parameter[0] == '"')
+        {
+            parameter.remove_prefix(1);
+            return std::string(parameter.substr(0, parameter.find('"')));
+        }
+
+        return std::string(trim(parameter.substr(0, parameter.find(';'))));
+    }
+
+    return "";
+}
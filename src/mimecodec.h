@@ -0,0 +1,64 @@
+/**
+ * @brief MIME transfer encodings
+ *
+ * @file mimecodec.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _MIMECODEC__H
+#define _MIMECODEC__H
+
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Quoted-printable and base64 (RFC 2045, RFC 2047).
+ *
+ *  The decoders are lenient; they take mail as it's really sent
+ *  and skip what they don't understand.
+ */
+class MimeCodec
+{
+    public:
+        /**
+         * @brief Decode a line of quoted-printable text.
+         *
+         * @param[in] text The line without the \\r\\n.
+         * @param[in] isHeader Decode an RFC 2047 "Q" word ('_' is a space).
+         * @param[out] output The decoded bytes, without the soft line break.
+         * @return void
+         */
+        static void decodeQuotedPrintable(std::string_view text, bool isHeader, std::string* output);
+
+        /**
+         * @brief Decode a piece of base64.
+         *
+         * @param[in] text The piece, line breaks and other junk are skipped.
+         * @param[in,out] carry Characters of an incomplete group, passed
+         *                      from one piece to the next.
+         * @param[out] output The decoded bytes.
+         * @return void
+         */
+        static void decodeBase64(std::string_view text, std::string* carry, std::string* output);
+
+        /**
+         * @brief Encode data as base64, without line breaks.
+         *
+         * @param[in] data The data.
+         * @param[out] output The encoded data are appended here.
+         * @return void
+         */
+        static void encodeBase64(std::string_view data, std::string* output);
+
+        /**
+         * @brief Get a parameter of a header field value.
+         *
+         * @param[in] value E.g. "text/plain; charset=utf-8".
+         * @param[in] name E.g. "charset", case doesn't matter.
+         * @return The value of the parameter, empty when it's missing.
+         */
+        static std::string getParameter(std::string const& value, std::string const& name);
+};
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @brief Implementation of PatternMatcher
+ *
+ * @file patternmatcher.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "patternmatcher.h"
+
+#include <string.h>
+
+namespace
+{
+    uint8_t toLower(uint8_t c)
+    {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+}
+
+PatternMatcher::PatternMatcher()
+    : classCount(1)
+{
+    memset(classes, 0, sizeof(classes));
+}
+
+int PatternMatcher::add(std::string_view pattern)
+{
+    std::vector<uint8_t> folded;
+    for (size_t i = 0; i < pattern.length(); i++)
+    {
+        folded.push_back(toLower(pattern[i]));
+    }
+
+    patterns.push_back(folded);
+    return patterns.size() - 1;
+}
+
+void PatternMatcher::compile()
+{
+    /* Classes of the bytes the patterns use */
+    classCount = 1;
+    memset(classes, 0, sizeof(classes));
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        for (size_t j = 0; j < patterns[i].size(); j++)
+        {
+            uint8_t c = patterns[i][j];
+            if (classes[c] == 0)
+            {
+                classes[c] = classCount++;
+            }
+        }
+    }
+    for (unsigned c = 'A'; c <= 'Z'; c++)
+    {
+        classes[c] = classes[toLower(c)];
+    }
+
+    /* The trie, -1 stands for no edge */
+    transitions.assign(classCount, -1);
+    std::vector<std::vector<int> > patternsOf(1);
+
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        int32_t state = 0;
+        for (size_t j = 0; j < patterns[i].size(); j++)
+        {
+            size_t edge = state * classCount + classes[patterns[i][j]];
+            if (transitions[edge] < 0)
+            {
+                transitions[edge] = patternsOf.size();
+                patternsOf.push_back(std::vector<int>());
+                transitions.resize(transitions.size() + classCount, -1);
+            }
+            state = transitions[edge];
+        }
+        patternsOf[state].push_back(i);
+    }
+
+    /* Breadth-first, so the failure state of each state is complete
+       before the state itself. The missing edges are replaced by the
+       edges of the failure state, which makes the automaton a DFA. */
+    size_t stateCount = patternsOf.size();
+    std::vector<int32_t> failures(stateCount, 0);
+    dictionaryLinks.assign(stateCount, -1);
+
+    std::vector<int32_t> queue;
+    for (unsigned c = 0; c < classCount; c++)
+    {
+        int32_t& next = transitions[c];
+        if (next < 0)
+        {
+            next = 0;
+        }
+        else
+        {
+            queue.push_back(next);
+        }
+    }
+
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        int32_t state = queue[head];
+        int32_t failure = failures[state];
+
+        for (unsigned c = 0; c < classCount; c++)
+        {
+            int32_t& next = transitions[state * classCount + c];
+            int32_t fallback = transitions[failure * classCount + c];
+            if (next < 0)
+            {
+                next = fallback;
+                continue;
+            }
+
+            failures[next] = fallback;
+            dictionaryLinks[next] = patternsOf[fallback].empty() ? dictionaryLinks[fallback] : fallback;
+            queue.push_back(next);
+        }
+    }
+
+    outputOffsets.assign(1, 0);
+    outputs.clear();
+    for (size_t state = 0; state < stateCount; state++)
+    {
+        outputs.insert(outputs.end(), patternsOf[state].begin(), patternsOf[state].end());
+        outputOffsets.push_back(outputs.size());
+    }
+}
+
+void PatternMatcher::match(std::string_view text, std::vector<int>* matches) const
+{
+    if (transitions.empty())
+    {
+        return;
+    }
+
+    int32_t state = 0;
+    for (size_t i = 0; i < text.length(); i++)
+    {
+        state = transitions[state * classCount + classes[static_cast<uint8_t>(text[i])]];
+
+        for (int32_t output = state; output >= 0; output = dictionaryLinks[output])
+        {
+            matches->insert(matches->end(), outputs.begin() + outputOffsets[output],
+                            outputs.begin() + outputOffsets[output + 1]);
+        }
+    }
+}
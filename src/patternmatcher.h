@@ -0,0 +1,72 @@
+/**
+ * @brief Multi-pattern substring search
+ *
+ * @file patternmatcher.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _PATTERNMATCHER__H
+#define _PATTERNMATCHER__H
+
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Finds many patterns in a text at once (Aho-Corasick).
+ *
+ *  The patterns are compiled into a deterministic automaton that
+ *  reads each byte of the text exactly once, no matter how many
+ *  patterns there are. ASCII letters match regardless of case.
+ *
+ *  The transitions are a dense table. To keep it small, the bytes
+ *  are mapped to classes first: each byte that occurs in some
+ *  pattern has its own class and all the others share class 0, so
+ *  a row has only as many columns as the patterns use characters.
+ */
+class PatternMatcher
+{
+    unsigned classCount;
+    uint8_t classes[256];
+
+    std::vector<int32_t> transitions;   /*< State x class -> state */
+    std::vector<int32_t> dictionaryLinks; /*< Next state on the suffix chain with a match, or -1 */
+    std::vector<uint32_t> outputOffsets;  /*< Patterns of state s: outputs[offsets[s]..offsets[s + 1]] */
+    std::vector<int> outputs;
+
+    /* The patterns until compile() */
+    std::vector<std::vector<uint8_t> > patterns;
+
+    public:
+        PatternMatcher();
+
+        /**
+         * @brief Add a pattern. Only before compile().
+         *
+         * @param[in] pattern Non-empty pattern.
+         * @return Number of the pattern, counted from 0.
+         */
+        int add(std::string_view pattern);
+
+        /**
+         * @brief Build the automaton.
+         *
+         * @return void
+         */
+        void compile();
+
+        /**
+         * @brief Find the patterns that occur in a text.
+         *
+         * @param[in] text The text.
+         * @param[out] matches Numbers of the patterns found are appended,
+         *             once for each occurrence.
+         * @return void
+         */
+        void match(std::string_view text, std::vector<int>* matches) const;
+
+        size_t size() const { return patterns.size(); }
+};
+
+#endif
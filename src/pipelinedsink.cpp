@@ -0,0 +1,271 @@
+/**
+ * @brief Implementation of PipelinedSink
+ *
+ * @file pipelinedsink.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "pipelinedsink.h"
+
+#include <algorithm>
+#include <string.h>
+
+PipelinedSink::PipelinedSink(MessageSink* storageSink)
+    : sink(storageSink), slots(SLOT_COUNT), published(0), released(0), openData(NO_DATA),
+      isStorageWaiting(false), isNetworkWaiting(false), isStopping(false), hasFailed(false)
+{
+    for (std::vector<Slot>::iterator slot = slots.begin(); slot != slots.end(); slot++)
+    {
+        slot->data.resize(SLOT_SIZE);
+        slot->used = 0;
+    }
+
+    storage = std::thread(&PipelinedSink::runStorage, this);
+}
+
+PipelinedSink::~PipelinedSink()
+{
+    /* Also after an error; the storage thread gets whatever
+       was received, the same as an unpipelined sink would. */
+    if (openSlot().used > 0)
+    {
+        publish();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    slotPublished.notify_one();
+
+    storage.join();
+}
+
+void PipelinedSink::begin(MessageInfo const& message)
+{
+    checkFailure();
+
+    char* payload = appendRecord(BEGIN, sizeof(message.id) + sizeof(message.size) + message.uid.length());
+    memcpy(payload, &message.id, sizeof(message.id));
+    payload += sizeof(message.id);
+    memcpy(payload, &message.size, sizeof(message.size));
+    payload += sizeof(message.size);
+    memcpy(payload, message.uid.data(), message.uid.length());
+}
+
+void PipelinedSink::write(const char* data, size_t length)
+{
+    checkFailure();
+
+    while (length > 0)
+    {
+        Slot& slot = openSlot();
+        if (openData == NO_DATA)
+        {
+            if (slot.data.size() - slot.used <= sizeof(RecordHeader))
+            {
+                publish();
+                continue;
+            }
+
+            appendRecord(DATA, 0);
+            openData = slot.used - sizeof(RecordHeader);
+        }
+
+        /* Consecutive writes grow the same record. */
+        size_t chunk = std::min(length, slot.data.size() - slot.used);
+        if (chunk == 0)
+        {
+            publish();
+            continue;
+        }
+
+        memcpy(&slot.data[slot.used], data, chunk);
+        slot.used += chunk;
+
+        RecordHeader header;
+        memcpy(&header, &slot.data[openData], sizeof(header));
+        header.length += chunk;
+        memcpy(&slot.data[openData], &header, sizeof(header));
+
+        data   += chunk;
+        length -= chunk;
+    }
+}
+
+void PipelinedSink::end()
+{
+    checkFailure();
+    appendRecord(END, 0);
+}
+
+void PipelinedSink::commit()
+{
+    requestCommit();
+    drain();
+}
+
+void PipelinedSink::requestCommit()
+{
+    checkFailure();
+    appendRecord(COMMIT, 0);
+    publish();
+}
+
+void PipelinedSink::drain()
+{
+    if (openSlot().used > 0)
+    {
+        publish();
+    }
+
+    waitForBacklog(0);
+    checkFailure();
+}
+
+char* PipelinedSink::appendRecord(RecordType type, size_t length)
+{
+    size_t needed = sizeof(RecordHeader) + length;
+    if (openSlot().data.size() - openSlot().used < needed)
+    {
+        publish();
+    }
+
+    Slot& slot = openSlot();
+    if (slot.data.size() < needed) /* Only a huge uid */
+    {
+        slot.data.resize(needed);
+    }
+
+    RecordHeader header;
+    header.type   = type;
+    header.length = length;
+    memcpy(&slot.data[slot.used], &header, sizeof(header));
+
+    char* payload = &slot.data[0] + slot.used + sizeof(header);
+    slot.used += needed;
+    openData = NO_DATA;
+
+    return payload;
+}
+
+void PipelinedSink::publish()
+{
+    published++;
+    openData = NO_DATA;
+
+    if (isStorageWaiting)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slotPublished.notify_one();
+    }
+
+    /* The next slot is where the storage thread was SLOT_COUNT
+       slots ago; this is where the backpressure comes from. */
+    waitForBacklog(SLOT_COUNT - 1);
+    openSlot().used = 0;
+}
+
+void PipelinedSink::waitForBacklog(size_t backlog)
+{
+    size_t target = published;
+    if (released + backlog >= target)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    isNetworkWaiting = true;
+    slotReleased.wait(lock, [&] { return released + backlog >= target; });
+    isNetworkWaiting = false;
+}
+
+void PipelinedSink::checkFailure()
+{
+    if (hasFailed)
+    {
+        std::rethrow_exception(failure);
+    }
+}
+
+void PipelinedSink::runStorage()
+{
+    size_t next = 0;
+    while (true)
+    {
+        if (published == next)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            isStorageWaiting = true;
+            slotPublished.wait(lock, [&] { return published != next || isStopping; });
+            isStorageWaiting = false;
+
+            if (published == next)
+            {
+                break; /* Stopping and there's nothing left. */
+            }
+        }
+
+        /* After a failure the slots are only recycled, so the
+           network thread never waits for nothing. */
+        if (!hasFailed)
+        {
+            try
+            {
+                replay(slots[next % SLOT_COUNT]);
+            }
+            catch (...)
+            {
+                failure   = std::current_exception();
+                hasFailed = true;
+            }
+        }
+
+        released = ++next;
+
+        if (isNetworkWaiting)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slotReleased.notify_one();
+        }
+    }
+}
+
+void PipelinedSink::replay(Slot const& slot)
+{
+    const char* data = slot.data.data();
+    size_t offset = 0;
+
+    while (offset < slot.used)
+    {
+        RecordHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        const char* payload = data + offset + sizeof(header);
+        offset += sizeof(header) + header.length;
+
+        switch (header.type)
+        {
+            case BEGIN:
+                memcpy(&replayed.id, payload, sizeof(replayed.id));
+                payload += sizeof(replayed.id);
+                memcpy(&replayed.size, payload, sizeof(replayed.size));
+                payload += sizeof(replayed.size);
+                replayed.uid.assign(payload, header.length - sizeof(replayed.id) - sizeof(replayed.size));
+                sink->begin(replayed);
+                break;
+
+            case DATA:
+                sink->write(payload, header.length);
+                break;
+
+            case END:
+                sink->end();
+                break;
+
+            case COMMIT:
+                sink->commit();
+                break;
+        }
+    }
+}
@@ -0,0 +1,162 @@
+/**
+ * @brief Message sink running in its own thread
+ *
+ * @file pipelinedsink.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _PIPELINEDSINK__H
+#define _PIPELINEDSINK__H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "messagesink.h"
+
+/**
+ * @brief Decouples receiving the messages from storing them.
+ *
+ *  The calls of the sink are recorded into a ring of buffers
+ *  (slots) and another thread replays them on the wrapped sink.
+ *  The thread that reads the socket thus never waits for the
+ *  disk, and the disk keeps writing while the network is slow;
+ *  the throughput is the lower of the two instead of being
+ *  limited by their sum.
+ *
+ *  The ring has a single producer and a single consumer, so the
+ *  slots are passed back and forth by two atomic counters without
+ *  any lock. A thread sleeps only when it can't go on: the storage
+ *  thread when all the slots are empty, the network thread when
+ *  all of them are full. The latter is the backpressure -- the
+ *  socket isn't read until the disk catches up, so the kernel
+ *  shrinks the TCP window. The slots are allocated once and
+ *  reused; many small messages share a slot.
+ *
+ *  The wrapped sink must not be used by anyone else until the
+ *  PipelinedSink is drained or destroyed. When it throws, the
+ *  error is thrown by the next call of the PipelinedSink.
+ */
+class PipelinedSink : public MessageSink
+{
+    static const size_t SLOT_COUNT = 8;
+    static const size_t SLOT_SIZE  = 256 * 1024;
+    static const size_t NO_DATA    = static_cast<size_t>(-1);
+
+    enum RecordType
+    {
+        BEGIN,
+        DATA,
+        END,
+        COMMIT
+    };
+
+    /* Each call is a header followed by the payload. */
+    struct RecordHeader
+    {
+        uint32_t type;
+        uint32_t length; /*< Of the payload */
+    };
+
+    struct Slot
+    {
+        std::vector<char> data;
+        size_t used;
+    };
+
+    MessageSink* sink;
+
+    std::vector<Slot> slots;
+    std::atomic<size_t> published; /*< Slots passed to the storage thread so far */
+    std::atomic<size_t> released;  /*< Slots the storage thread is done with */
+    size_t openData;               /*< Offset of the DATA header being extended, or NO_DATA */
+
+    std::mutex mutex;              /*< Only for sleeping */
+    std::condition_variable slotPublished;
+    std::condition_variable slotReleased;
+    std::atomic<bool> isStorageWaiting;
+    std::atomic<bool> isNetworkWaiting;
+    std::atomic<bool> isStopping;
+
+    std::atomic<bool> hasFailed;
+    std::exception_ptr failure;
+
+    MessageInfo replayed;          /*< Storage thread only */
+    std::thread storage;
+
+    public:
+        /**
+         * @param[in] storageSink The sink to run in the storage thread.
+         */
+        PipelinedSink(MessageSink* storageSink);
+
+        /* Waits for the storage thread to finish what was passed to it. */
+        ~PipelinedSink();
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+
+        /**
+         * @brief Commit the wrapped sink and wait for it.
+         *
+         *  As the MessageSink contract requires, the messages are
+         *  durable when this returns. See requestCommit() for the
+         *  variant that doesn't wait.
+         *
+         * @return void
+         */
+        void commit();
+
+        /**
+         * @brief Commit the wrapped sink once it gets here.
+         *
+         *  Returns at once, the network goes on while the storage
+         *  thread flushes. The messages are durable after drain().
+         *
+         * @return void
+         */
+        void requestCommit();
+
+        /**
+         * @brief Wait until the storage thread handled everything.
+         *
+         * @return void
+         */
+        void drain();
+
+    private:
+        Slot& openSlot() { return slots[published.load(std::memory_order_relaxed) % SLOT_COUNT]; }
+
+        /**
+         * @brief Add a record to the open slot.
+         *
+         * @param[in] type Type of the record.
+         * @param[in] length Length of the payload.
+         * @return Where to store the payload.
+         */
+        char* appendRecord(RecordType type, size_t length);
+
+        /**
+         * @brief Pass the open slot to the storage thread.
+         *
+         *  Waits until the storage thread frees the next slot.
+         *
+         * @return void
+         */
+        void publish();
+
+        /* Sleep until at most \c backlog slots wait for the storage thread. */
+        void waitForBacklog(size_t backlog);
+        void checkFailure();
+
+        void runStorage();
+        void replay(Slot const& slot);
+};
+
+#endif
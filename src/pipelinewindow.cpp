@@ -0,0 +1,109 @@
+/**
+ * @brief Implementation of PipelineWindow
+ *
+ * @file pipelinewindow.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "pipelinewindow.h"
+
+#include <algorithm>
+
+const size_t PipelineWindow::MIN_BYTES;
+const size_t PipelineWindow::INITIAL_BYTES;
+const size_t PipelineWindow::MAX_BYTES;
+const uint64_t PipelineWindow::MIN_STALL;
+const size_t PipelineWindow::MAX_COMMANDS;
+
+PipelineWindow::PipelineWindow()
+    : delivered(0), lastProgress(0), roundTripTime(0), nextRate(0),
+      ceiling(INITIAL_BYTES), isProbing(true)
+{
+    current.sent      = 0;
+    current.delivered = 0;
+
+    std::fill(rates, rates + RATE_SAMPLES, 0);
+}
+
+void PipelineWindow::addRoundTripTime(uint64_t sample)
+{
+    if (sample > 0 && (roundTripTime == 0 || sample < roundTripTime))
+    {
+        roundTripTime = sample;
+    }
+}
+
+void PipelineWindow::sent(uint64_t now)
+{
+    Command command;
+    command.sent      = now;
+    command.delivered = delivered;
+
+    outstanding.push_back(command);
+}
+
+void PipelineWindow::responded(bool status, uint64_t now)
+{
+    if (outstanding.empty())
+    {
+        return;
+    }
+
+    current = outstanding.front();
+    outstanding.pop_front();
+
+    /* Waiting behind other data makes the time longer, never shorter. */
+    addRoundTripTime(now - current.sent);
+
+    uint64_t waited = now - std::max(current.sent, lastProgress);
+    lastProgress = now;
+
+    if (!status || waited > std::max(MIN_STALL, 8 * roundTripTime))
+    {
+        shrink();
+    }
+}
+
+void PipelineWindow::completed(size_t bytes, uint64_t now)
+{
+    delivered += bytes;
+    lastProgress = now;
+
+    uint64_t interval = now - current.sent;
+    if (interval > 0)
+    {
+        rates[nextRate] = (delivered - current.delivered) * 1000000 / interval;
+        nextRate = (nextRate + 1) % RATE_SAMPLES;
+    }
+
+    /* Like TCP: slow start until the first trouble, then
+       about MIN_BYTES more for each window delivered. */
+    size_t growth = isProbing ? bytes : bytes * MIN_BYTES / ceiling;
+    ceiling = std::min(MAX_BYTES, ceiling + std::max(growth, size_t(1)));
+}
+
+size_t PipelineWindow::getBytes() const
+{
+    size_t window = ceiling;
+
+    uint64_t bandwidth = getBandwidth();
+    if (bandwidth > 0 && roundTripTime > 0)
+    {
+        uint64_t product = bandwidth * roundTripTime / 1000000;
+        window = std::min<uint64_t>(window, 2 * product);
+    }
+
+    return std::max(MIN_BYTES, std::min(MAX_BYTES, window));
+}
+
+uint64_t PipelineWindow::getBandwidth() const
+{
+    return *std::max_element(rates, rates + RATE_SAMPLES);
+}
+
+void PipelineWindow::shrink()
+{
+    ceiling   = std::max(MIN_BYTES, getBytes() / 2);
+    isProbing = false;
+}
@@ -0,0 +1,93 @@
+/**
+ * @brief Sizing of the pipelining window
+ *
+ * @file pipelinewindow.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _PIPELINEWINDOW__H
+#define _PIPELINEWINDOW__H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+
+/**
+ * @brief How much data to keep requested ahead of what has arrived.
+ *
+ *  Pipelined commands keep the link busy only when they request
+ *  enough data to cover a round trip; requesting much more just
+ *  piles up in the server's buffers. The window is sized the way
+ *  a congestion controller like BBR sizes its own:
+ *
+ *    - the round trip time is the shortest time from a command to
+ *      its status line (the later commands of a pipeline wait for
+ *      the data before them),
+ *    - the bandwidth is the highest delivery rate of the last few
+ *      commands: the data that arrived while a command was
+ *      outstanding, divided by how long it was,
+ *    - the window is twice their product, the bandwidth-delay
+ *      product, which leaves room to find out the link is faster.
+ *
+ *  Before the estimates are known, the window starts at INITIAL_BYTES
+ *  and grows by the delivered data, doubling each round trip. A
+ *  refused command or a stall (a status line that takes far longer
+ *  than a round trip) halves it, and it grows only slowly after that.
+ *
+ *  The times are in microseconds of a monotonic clock.
+ */
+class PipelineWindow
+{
+    static const size_t MIN_BYTES     = 64 * 1024;
+    static const size_t INITIAL_BYTES = 256 * 1024;
+    static const size_t MAX_BYTES     = 64 * 1024 * 1024;
+    static const size_t RATE_SAMPLES  = 8;
+    static const uint64_t MIN_STALL   = 1000000;
+
+    struct Command
+    {
+        uint64_t sent;      /*< When it was sent */
+        uint64_t delivered; /*< Bytes delivered by then */
+    };
+
+    std::deque<Command> outstanding;
+    Command current;        /*< The command whose data are arriving */
+    uint64_t delivered;     /*< Bytes delivered so far */
+    uint64_t lastProgress;  /*< Last status line or end of data */
+
+    uint64_t roundTripTime; /*< Shortest seen, 0 unknown */
+    uint64_t rates[RATE_SAMPLES]; /*< Bytes per second */
+    size_t nextRate;
+    size_t ceiling;         /*< Limit that grows with the delivered data */
+    bool isProbing;         /*< No trouble yet, the ceiling doubles */
+
+    public:
+        /* Most commands in flight, whatever their size. */
+        static const size_t MAX_COMMANDS = 256;
+
+        PipelineWindow();
+
+        /* A command was sent. */
+        void sent(uint64_t now);
+
+        /* The status line of the oldest outstanding command arrived. */
+        void responded(bool status, uint64_t now);
+
+        /* The data of the last command that responded ended. */
+        void completed(size_t bytes, uint64_t now);
+
+        /**
+         * @brief Bytes that may be requested and not yet received.
+         */
+        size_t getBytes() const;
+
+        uint64_t getRoundTripTime() const { return roundTripTime; }
+        uint64_t getBandwidth() const;
+
+    private:
+        void addRoundTripTime(uint64_t sample);
+        void shrink();
+};
+
+#endif
@@ -8,16 +8,32 @@
 
 #include "pop3session.h"
 
-#include <iostream>
-#include <sstream>
+#include <algorithm>
+#include <charconv>
+#include <stdlib.h>
+#include <time.h>
 
+#include "probes.h"
 #include "socket.h"
 
+namespace
+{
+    /* Microseconds of the monotonic clock. */
+    uint64_t getTime()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return uint64_t(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    }
+}
+
 Pop3Session::Pop3Session()
-    : socket(NULL)
+    : socket(NULL), dataLength(0), profile(NULL)
 {}
 
-Pop3Session::Pop3Session(std::string const& server, int port)
+Pop3Session::Pop3Session(std::string const& server, int port, ServerProfile* serverProfile)
+    : socket(NULL), dataLength(0), profile(serverProfile)
 {
     open(server, port);
 }
@@ -27,69 +43,223 @@ Pop3Session::~Pop3Session()
    close();
 }
 
-void Pop3Session::sendCommand(std::string const& command)
+void Pop3Session::sendCommand(const char* keyword)
 {
-    socket->write(command + "\r\n");
+    PROBE2(command, keyword, 0);
+
+    commandBuffer.assign(keyword);
+    finishCommand();
 }
 
-void Pop3Session::getResponse(ServerResponse* response)
+void Pop3Session::sendCommand(const char* keyword, std::string const& argument)
+{
+    /* The argument may be a password, it isn't traced. */
+    PROBE2(command, keyword, 0);
+
+    commandBuffer.assign(keyword);
+    commandBuffer += ' ';
+    commandBuffer += argument;
+    finishCommand();
+}
+
+void Pop3Session::sendCommand(const char* keyword, int argument)
+{
+    PROBE2(command, keyword, argument);
+
+    commandBuffer.assign(keyword);
+    appendNumber(argument);
+    finishCommand();
+}
+
+void Pop3Session::sendCommand(const char* keyword, int argument, unsigned secondArgument)
+{
+    PROBE2(command, keyword, argument);
+
+    commandBuffer.assign(keyword);
+    appendNumber(argument);
+    appendNumber(secondArgument);
+    finishCommand();
+}
+
+void Pop3Session::appendNumber(long number)
+{
+    char digits[24];
+    digits[0] = ' ';
+
+    char* end = std::to_chars(digits + 1, digits + sizeof(digits), number).ptr;
+    commandBuffer.append(digits, end - digits);
+}
+
+void Pop3Session::finishCommand()
+{
+    commandBuffer += "\r\n";
+    socket->write(commandBuffer.data(), commandBuffer.length());
+}
+
+void Pop3Session::nextEvent(ResponseParser::Event* event)
 {
-    std::string buffer;
-    socket->readLine(&buffer);
+    do
+    {
+        std::string_view input = socket->fill();
+        if (input.empty())
+        {
+            throw Socket::IOError("Recieving error", "Connection closed by remote host");
+        }
+
+        socket->consume(parser.parse(input.data(), input.length(), event));
+    }
+    while (event->type == ResponseParser::NEED_MORE);
 
-    if (buffer[0] == '+')
+    if (event->type == ResponseParser::DATA)
     {
-        response->status = true;
-        buffer.erase(0, 4); // Remove the "+OK "
+        dataLength += event->text.length();
     }
-    else
+    else if (event->type == ResponseParser::END)
     {
-        response->status = false;
-        buffer.erase(0, 5); // Remove the "-ERR "
+        PROBE1(data_end, dataLength);
+        dataLength = 0;
     }
+}
+
+void Pop3Session::getResponse(ServerResponse* response)
+{
+    ResponseParser::Event event;
+    nextEvent(&event);
+    PROBE3(response, event.status, event.text.data(), event.text.length());
+
+    response->status = event.status;
+    response->statusMessage.assign(event.text);
+
+    response->data.clear();
+}
+
+void Pop3Session::getGreeting(ServerResponse* response)
+{
+    /* Not a response probe, it would have no command to pair with. */
+    ResponseParser::Event event;
+    nextEvent(&event);
+    PROBE3(greeting, event.status, event.text.data(), event.text.length());
+
+    response->status = event.status;
+    response->statusMessage.assign(event.text);
 
-    response->statusMessage = buffer;
     response->data.clear();
 }
 
 void Pop3Session::getMultilineData(ServerResponse* response)
 {
-    std::string buffer;
-    int bytesRead;
+    parser.expectData();
+
+    std::string_view line;
+    while (getDataLine(&line))
+    {
+        response->data.appendLine(line.data(), line.length());
+    }
+}
+
+void Pop3Session::getMultilineData(MessageSink* sink)
+{
+    parser.expectData();
 
+    ResponseParser::Event event;
     while (true)
     {
-        buffer.clear();
-        
-        bytesRead = socket->readLine(&buffer);
-        
-        if (buffer == "." || bytesRead == 0)
+        nextEvent(&event);
+        if (event.type == ResponseParser::END)
         {
             break;
         }
-        else
+
+        sink->write(event.text.data(), event.text.length());
+    }
+}
+
+bool Pop3Session::getDataLine(std::string_view* line)
+{
+    lineBuffer.clear();
+
+    while (true)
+    {
+        if (pendingData.empty())
         {
-            if (buffer[0] == '.') /* Strip byte stuffed characters. */
+            ResponseParser::Event event;
+            nextEvent(&event);
+            if (event.type == ResponseParser::END)
             {
-                buffer.erase(0, 1);
+                return false;
             }
+            pendingData = event.text;
+        }
+
+        size_t newline = pendingData.find('\n');
+        if (newline == std::string_view::npos)
+        {
+            lineBuffer.append(pendingData);
+            pendingData = std::string_view();
+            continue;
+        }
 
-            response->data.push_back(buffer);
+        /* Lines that arrived whole are used in place. */
+        if (lineBuffer.empty())
+        {
+            *line = pendingData.substr(0, newline);
         }
+        else
+        {
+            lineBuffer.append(pendingData, 0, newline);
+            *line = lineBuffer;
+        }
+        pendingData.remove_prefix(newline + 1);
+
+        if (!line->empty() && line->back() == '\r')
+        {
+            line->remove_suffix(1);
+        }
+        return true;
     }
 }
 
 void Pop3Session::open(std::string const& server, int port)
 {
-    socket = new Socket(server, port);
-    
-    ServerResponse welcomeMessage;
+    bool isFresh = profile != NULL && profile->isFresh(time(NULL));
+
+    /* Skip the DNS lookup; the name is resolved again
+       when the address doesn't work anymore. */
+    if (isFresh && !profile->address.empty())
+    {
+        try
+        {
+            socket = new Socket(profile->address, port);
+        }
+        catch (Socket::ConnectionError&)
+        {
+            socket = NULL;
+        }
+    }
+
+    if (socket == NULL)
+    {
+        socket = new Socket(server, port);
+    }
     
-    getResponse(&welcomeMessage);
+    getGreeting(&response);
 
-    if (!welcomeMessage.status)
+    if (!response.status)
     {
-        throw ServerError("Conection refused", welcomeMessage.statusMessage);
+        throw ServerError("Conection refused", response.statusMessage);
+    }
+
+    if (profile != NULL)
+    {
+        /* A different greeting usually means different software. */
+        uint32_t greeting = ServerProfile::getGreetingChecksum(response.statusMessage);
+        if (!isFresh || greeting != profile->greeting)
+        {
+            profile->forgetCapabilities();
+        }
+
+        profile->greeting = greeting;
+        profile->address  = socket->getPeerAddress();
     }
 }
 
@@ -99,40 +269,154 @@ void Pop3Session::close()
     {
         sendCommand("QUIT");
 
-        //ServerResponse quitACK;
-        //getResponse(&quitACK);
-
-        /* Maybe print a warning when QUIT fails? */
+        /* The reply doesn't matter here; sessions that need
+           the QUIT to succeed end with quit(). */
 
         delete socket;
+        socket = NULL;
     }
 }
 
 void Pop3Session::authenticate(std::string const& username, std::string const& password)
 {
-    ServerResponse response;
+    if (profile != NULL && profile->discovered == 0)
+    {
+        sendCommand("CAPA");
+        parseCapabilities();
+    }
+
+    if (profile != NULL && profile->hasCapability("PIPELINING"))
+    {
+        sendCommand("USER", username);
+        sendCommand("PASS", password);
+
+        getResponse(&response);
+        std::string failure = response.statusMessage;
+        bool authenticated = response.status;
+
+        getResponse(&response);
+        if (!authenticated || !response.status)
+        {
+            throw ServerError("Authentication failed", authenticated ? response.statusMessage : failure);
+        }
+    }
+    else
+    {
+        sendCommand("USER", username);
+        getResponse(&response);
+
+        if (!response.status)
+        {
+            throw ServerError("Authentication failed", response.statusMessage);
+        }
+
+        sendCommand("PASS", password);
+        getResponse(&response);
+
+        if (!response.status)
+        {
+            throw ServerError("Authentication failed", response.statusMessage);
+        }
+    }
+
+    if (profile != NULL)
+    {
+        profile->addRoundTripTime(socket->getRoundTripTime());
+    }
+}
+
+void Pop3Session::authenticate(std::string const& username, std::string const& password,
+                               MailboxStatus* status)
+{
+    /* Commands can't be pipelined before the server said it
+       supports that (RFC 2449), so CAPA goes alone the first time. */
+    if (profile != NULL && profile->discovered == 0)
+    {
+        sendCommand("CAPA");
+        parseCapabilities();
+    }
+
+    if (profile == NULL || !profile->hasCapability("PIPELINING"))
+    {
+        authenticate(username, password);
+        getStatus(status);
+        return;
+    }
+
+    sendCommand("USER", username);
+    sendCommand("PASS", password);
+    sendCommand("STAT");
+
+    /* All the replies must be read even when USER fails. */
+    bool authenticated = true;
+    std::string failure;
+    for (int i = 0; i < 2; i++)
+    {
+        getResponse(&response);
+        if (!response.status && authenticated)
+        {
+            authenticated = false;
+            failure = response.statusMessage;
+        }
+    }
 
-    sendCommand("USER " + username);
     getResponse(&response);
+    if (!authenticated)
+    {
+        throw ServerError("Authentication failed", failure);
+    }
 
-    if (!response.status)
+    parseStatus(status);
+
+    if (profile != NULL)
     {
-        throw ServerError("Authentication failed", response.statusMessage);
+        profile->addRoundTripTime(socket->getRoundTripTime());
     }
+}
 
-    sendCommand("PASS " + password);
+void Pop3Session::getStatus(MailboxStatus* status)
+{
+    sendCommand("STAT");
     getResponse(&response);
 
+    parseStatus(status);
+}
+
+void Pop3Session::parseStatus(MailboxStatus* status)
+{
     if (!response.status)
     {
-        throw ServerError("Authentication failed", response.statusMessage);
+        throw ServerError("Unable to retrieve maildrop status", response.statusMessage);
     }
+
+    /* "+OK <count> <octets>" */
+    char* sizePosition;
+    status->count = strtoul(response.statusMessage.c_str(), &sizePosition, 10);
+    status->size  = strtoul(sizePosition, NULL, 10);
 }
 
-void Pop3Session::printMessageList()
+void Pop3Session::parseCapabilities()
 {
-    ServerResponse response;
+    getResponse(&response);
+
+    profile->discovered    = time(NULL);
+    profile->capaSupported = response.status;
+    profile->capabilities.clear();
+
+    if (!response.status)
+    {
+        return;
+    }
+
+    getMultilineData(&response);
+    for (size_t i = 0; i < response.data.size(); i++)
+    {
+        profile->capabilities.push_back(std::string(response.data.line(i)));
+    }
+}
 
+void Pop3Session::getListing(ScanListing* listing)
+{
     sendCommand("LIST");
 
     getResponse(&response);
@@ -141,31 +425,110 @@ void Pop3Session::printMessageList()
         throw ServerError("Unable to retrieve message list", response.statusMessage);
     }
 
-    getMultilineData(&response);
+    listing->clear();
+    parser.expectData();
+
+    std::string_view line;
+    while (getDataLine(&line))
+    {
+        listing->parseListLine(line);
+    }
+}
+
+bool Pop3Session::getUniqueIds(ScanListing* listing)
+{
+    if (profile != NULL && profile->lacksCapability("UIDL"))
+    {
+        return false;
+    }
+
+    sendCommand("UIDL");
+
+    getResponse(&response);
+    if (!response.status)
+    {
+        return false;
+    }
 
-    if (response.data.size() == 0)
+    listing->clearUids();
+    parser.expectData();
+
+    std::string_view line;
+    while (getDataLine(&line))
+    {
+        listing->parseUidLine(line);
+    }
+
+    return true;
+}
+
+void Pop3Session::getMessageList(std::vector<MessageInfo>* messages)
+{
+    getListing(&listing);
+
+    messages->clear();
+    messages->reserve(listing.size());
+    for (size_t i = 0; i < listing.size(); i++)
+    {
+        messages->push_back(MessageInfo(listing.getId(i), listing.getSize(i)));
+    }
+}
+
+bool Pop3Session::getUniqueIds(std::vector<MessageInfo>* messages)
+{
+    listing.clear();
+    for (std::vector<MessageInfo>::iterator message = messages->begin(); message != messages->end(); message++)
     {
-        std::cout << "No messages available on the server." << std::endl;
+        listing.add(message->id, message->size);
     }
 
-    int spacePosition = 0;
-    for (std::list<std::string>::iterator line = response.data.begin();
-         line != response.data.end();
-         line++)
+    if (!getUniqueIds(&listing))
     {
-        spacePosition = line->find(' ');
-        std::cout << line->substr(0, spacePosition) << std::endl;
+        return false;
     }
+
+    for (size_t i = 0; i < listing.size(); i++)
+    {
+        (*messages)[i].uid.assign(listing.getUid(i));
+    }
+
+    return true;
 }
 
-void Pop3Session::printMessage(int messageId)
+bool Pop3Session::getUniqueId(int messageId, std::string* uid)
 {
-    ServerResponse response;
+    if (profile != NULL && profile->lacksCapability("UIDL"))
+    {
+        return false;
+    }
+
+    sendCommand("UIDL", messageId);
+
+    getResponse(&response);
+    if (!response.status)
+    {
+        return false;
+    }
+
+    /* "+OK <id> <uid>" */
+    std::string::size_type start = response.statusMessage.find(' ');
+    if (start == std::string::npos)
+    {
+        return false;
+    }
 
-    std::stringstream command;
-    command << "RETR " << messageId;
+    uid->assign(response.statusMessage, start + 1, std::string::npos);
+    return true;
+}
 
-    sendCommand(command.str());
+void Pop3Session::retrieveMessage(int messageId, MessageSink* sink)
+{
+    retrieveMessage(MessageInfo(messageId), sink);
+}
+
+void Pop3Session::retrieveMessage(MessageInfo const& message, MessageSink* sink)
+{
+    sendCommand("RETR", message.id);
 
     getResponse(&response);
     if (!response.status)
@@ -173,12 +536,198 @@ void Pop3Session::printMessage(int messageId)
         throw ServerError("Unable to retrieve requested message", response.statusMessage);
     }
 
-    getMultilineData(&response);
-    
-    for (std::list<std::string>::iterator line = response.data.begin();
-         line != response.data.end();
-         line++)
+    /* Most servers announce the size as "+OK <octets> octets". */
+    MessageInfo retrieved = message;
+    if (retrieved.size == 0)
+    {
+        retrieved.size = strtoul(response.statusMessage.c_str(), NULL, 10);
+    }
+
+    sink->begin(retrieved);
+    getMultilineData(sink);
+    sink->end();
+}
+
+void Pop3Session::retrieveTop(int messageId, unsigned lines, MessageSink* sink)
+{
+    sendCommand("TOP", messageId, lines);
+
+    getResponse(&response);
+    if (!response.status)
+    {
+        throw ServerError("Unable to retrieve message headers", response.statusMessage);
+    }
+
+    sink->begin(MessageInfo(messageId));
+    getMultilineData(sink);
+    sink->end();
+}
+
+void Pop3Session::retrieveMessages(std::vector<MessageInfo> const& messages, MessageSink* sink,
+                                   std::vector<int>* failedIds)
+{
+    size_t next = 0;      /* First message not requested yet */
+    size_t requested = 0; /* Bytes requested and not received */
+
+    bool failed = false;
+    std::string firstError;
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        while (next < messages.size() &&
+               (next == i || (next - i < PipelineWindow::MAX_COMMANDS &&
+                              requested + messages[next].size <= window.getBytes())))
+        {
+            sendCommand("RETR", messages[next].id);
+            window.sent(getTime());
+            requested += messages[next].size;
+            next++;
+        }
+
+        getResponse(&response);
+        window.responded(response.status, getTime());
+
+        if (!response.status)
+        {
+            requested -= messages[i].size;
+            if (!failed)
+            {
+                failed = true;
+                firstError = response.statusMessage;
+            }
+            if (failedIds != NULL)
+            {
+                failedIds->push_back(messages[i].id);
+            }
+            continue;
+        }
+
+        sink->begin(messages[i]);
+        getMultilineData(sink);
+        sink->end();
+
+        window.completed(messages[i].size, getTime());
+        requested -= messages[i].size;
+    }
+
+    if (failed && failedIds == NULL)
+    {
+        throw ServerError("Unable to retrieve requested message", firstError);
+    }
+}
+
+void Pop3Session::retrieveHeaders(std::vector<MessageInfo> const& messages, MessageSink* sink,
+                                  std::vector<int>* failed)
+{
+    if (profile != NULL && profile->lacksCapability("TOP"))
+    {
+        for (size_t i = 0; i < messages.size(); i++)
+        {
+            failed->push_back(messages[i].id);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        sendCommand("TOP", messages[i].id, 0);
+    }
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        getResponse(&response);
+        if (!response.status)
+        {
+            failed->push_back(messages[i].id);
+            continue;
+        }
+
+        sink->begin(messages[i]);
+        getMultilineData(sink);
+        sink->end();
+    }
+}
+
+void Pop3Session::deleteMessages(std::vector<int> const& messageIds, std::vector<int>* failed)
+{
+    for (size_t i = 0; i < messageIds.size(); i++)
+    {
+        sendCommand("DELE", messageIds[i]);
+    }
+
+    for (size_t i = 0; i < messageIds.size(); i++)
     {
-        std::cout << *line << std::endl;
+        getResponse(&response);
+        if (!response.status)
+        {
+            failed->push_back(messageIds[i]);
+        }
+    }
+}
+
+void Pop3Session::quit()
+{
+    sendCommand("QUIT");
+    getResponse(&response);
+
+    delete socket;
+    socket = NULL;
+
+    if (!response.status)
+    {
+        throw ServerError("Server failed to end the session", response.statusMessage);
+    }
+}
+
+void Pop3Session::dumpMessage(int messageId, int fileDescriptor)
+{
+    static const size_t PEEK_SIZE = 65536;
+    std::vector<char> buffer(PEEK_SIZE);
+    char* peeked = &buffer[0];
+
+    sendCommand("RETR", messageId);
+
+    getResponse(&response);
+    if (!response.status)
+    {
+        throw ServerError("Unable to retrieve requested message", response.statusMessage);
+    }
+
+    /* Only the dots are dropped from the stream, everything
+       the parser passes as data is moved by the kernel. */
+    parser.expectData();
+
+    ResponseParser::Event event;
+    event.type = ResponseParser::NEED_MORE;
+    size_t bytes = 0;
+    do
+    {
+        size_t available = socket->peek(peeked, PEEK_SIZE);
+        if (available == 0)
+        {
+            throw Socket::IOError("Recieving error", "Connection closed by remote host");
+        }
+
+        for (size_t offset = 0; offset < available && event.type != ResponseParser::END; )
+        {
+            size_t consumed = parser.parse(peeked + offset, available - offset, &event);
+            size_t data = event.type == ResponseParser::DATA ? event.text.length() : 0;
+
+            if (data > 0 && event.text.data() != peeked + offset + consumed - data)
+            {
+                /* The \r after a stuffed dot doesn't come from the stream. */
+                socket->discard(consumed);
+                Socket::writeAll(fileDescriptor, event.text.data(), event.text.length());
+            }
+            else
+            {
+                socket->discard(consumed - data);
+                socket->transfer(fileDescriptor, data);
+            }
+
+            offset += consumed;
+            bytes  += data;
+        }
     }
+    while (event.type != ResponseParser::END);
+    PROBE1(data_end, bytes);
 }
@@ -9,10 +9,17 @@
 #ifndef _POP3SESSION__H
 #define _POP3SESSION__H
 
-#include <list>
 #include <string>
+#include <vector>
 
 #include "error.h"
+#include "messageinfo.h"
+#include "messagesink.h"
+#include "pipelinewindow.h"
+#include "responsebuffer.h"
+#include "responseparser.h"
+#include "scanlisting.h"
+#include "serverprofile.h"
 
 class Socket; /* Forward-declaration. */
 
@@ -22,21 +29,77 @@ class Socket; /* Forward-declaration. */
  *  This class is responsible for communication with the server using POP3
  *  over TCP. It sends POP3 commands to the server and process its responses.
  *
+ *  The session never prints anything. Listings are returned as data
+ *  structures and messages are streamed into a MessageSink provided
+ *  by the caller.
+ *
  */
 class Pop3Session
 {
+    /**
+     * @brief Data structure for POP3 server responses.
+     *
+     *  This is used internaly by Pop3Session to store server's
+     *  responses. A single instance is reused for all the commands
+     *  of a session, so its buffers are allocated only once.
+     */
+    struct ServerResponse
+    {
+        bool status; /*< It's true on +OK, false on -ERR */
+        std::string statusMessage;
+        ResponseBuffer data; /*< Multi-line data in case, they were present. */
+    };
+
     Socket* socket;
+    ServerResponse response;
+    ResponseParser parser;
+    std::string_view pendingData; /*< Data the parser passed and getDataLine() didn't use yet. */
+    size_t dataLength;      /*< Bytes of the data so far, for the data_end probe. */
+    std::string lineBuffer; /*< Lines split between fragments are joined here. */
+    ScanListing listing;    /*< Reused by getMessageList() and getUniqueIds(). */
+    std::string commandBuffer; /*< Commands are formatted here. */
+    ServerProfile* profile;    /*< What is known about the server, may be NULL. */
+    PipelineWindow window;     /*< How far retrieveMessages() requests ahead. */
 
     public:
+        /**
+         * @brief Size of the maildrop as reported by STAT.
+         */
+        struct MailboxStatus
+        {
+            size_t count; /*< Number of messages */
+            size_t size;  /*< Total size in octets */
+
+            bool operator==(MailboxStatus const& other) const
+            {
+                return count == other.count && size == other.size;
+            }
+        };
+
         Pop3Session();
-        Pop3Session(std::string const& server, int port);
+
+        /**
+         * @brief Connect to a server.
+         *
+         *  With a \c serverProfile from an earlier session, the session
+         *  connects to the cached address (falling back to the name when
+         *  it fails) and skips the capability discovery. The profile is
+         *  updated as the session goes; it has to outlive the session.
+         *
+         * @param[in] server Hostname or address of the server.
+         * @param[in] port TCP port.
+         * @param[in,out] serverProfile What is known about the server, or NULL.
+         */
+        Pop3Session(std::string const& server, int port, ServerProfile* serverProfile = NULL);
         ~Pop3Session();
 
         /**
          * @brief Authenticate user on the remote server.
          *
          *  The authentication is plain-text by issuing commands
-         *  USER and PASS.
+         *  USER and PASS. They are pipelined when the profile says
+         *  the server supports it. With a profile that doesn't know
+         *  the capabilities yet, CAPA is sent first.
          *
          * @param[in] username Username on remote POP3 server.
          * @param[in] password Password in plain-text form.
@@ -45,46 +108,234 @@ class Pop3Session
         void authenticate(std::string const& username, std::string const& password);
 
         /**
-         * @brief Print list of available messages.
+         * @brief Authenticate user and get the maildrop status.
+         *
+         *  USER, PASS and STAT are sent at once when the server
+         *  advertises PIPELINING, so the whole exchange costs a
+         *  single round trip. When the profile doesn't know the
+         *  capabilities yet, CAPA is sent alone first. Otherwise
+         *  the commands are sent one by one.
+         *
+         * @param[in] username Username on remote POP3 server.
+         * @param[in] password Password in plain-text form.
+         * @param[out] status Number and size of the messages.
+         * @return void
+         */
+        void authenticate(std::string const& username, std::string const& password,
+                          MailboxStatus* status);
+
+        /**
+         * @brief Get number and total size of the messages.
+         *
+         *  This method issues STAT command to the server.
+         *
+         * @param[out] status Where to store the status.
+         * @return void
+         */
+        void getStatus(MailboxStatus* status);
+
+        /**
+         * @brief Get ids and sizes of all available messages.
+         *
+         *  This method issues LIST command to the server. The lines
+         *  are parsed as they arrive, without storing the response.
+         *
+         * @param[out] listing Where to store the list.
+         * @return void
+         */
+        void getListing(ScanListing* listing);
+
+        /**
+         * @brief Fill in unique ids of a listing.
+         *
+         *  This method issues UIDL command to the server, unless
+         *  the profile says it isn't supported.
+         *
+         * @param[in,out] listing Listing from getListing().
+         * @return False when the server doesn't support UIDL.
+         */
+        bool getUniqueIds(ScanListing* listing);
+
+        /**
+         * @brief Get ids and sizes of all available messages.
+         *
+         *  Same as getListing(), with the messages described one by one.
+         *
+         * @param[out] messages Where to store the list.
+         * @return void
+         */
+        void getMessageList(std::vector<MessageInfo>* messages);
+
+        /**
+         * @brief Fill in unique ids of messages.
+         *
+         *  This method issues UIDL command to the server and
+         *  stores the unique ids into the \c uid fields of the
+         *  respective \c messages.
+         *
+         * @param[in,out] messages Messages from getMessageList().
+         * @return False when the server doesn't support UIDL.
+         */
+        bool getUniqueIds(std::vector<MessageInfo>* messages);
+
+        /**
+         * @brief Get the unique id of a single message.
+         *
+         *  Issues UIDL with the message id, unless the profile says
+         *  it isn't supported.
+         *
+         * @param[in] messageId Id of the message.
+         * @param[out] uid Where to store the unique id.
+         * @return False when the server doesn't support UIDL.
+         */
+        bool getUniqueId(int messageId, std::string* uid);
+
+        /**
+         * @brief Download message into a sink.
+         *
+         *  The message is passed to the \c sink line by line as
+         *  it arrives, so it is never held in memory as a whole.
+         *
+         * @param[in] messageId Id of the message to download.
+         * @param[in] sink Where to put the message.
+         * @return void
+         */
+        void retrieveMessage(int messageId, MessageSink* sink);
+
+        /**
+         * @brief Download message into a sink.
+         *
+         *  Same as above; the sink gets the \c message as it was
+         *  given (with its unique id), the size filled in from the
+         *  reply when it is unknown.
+         */
+        void retrieveMessage(MessageInfo const& message, MessageSink* sink);
+
+        /**
+         * @brief Download headers and beginning of a message.
+         *
+         *  This method issues TOP command, which is optional in
+         *  RFC 1939, so some servers may refuse it.
+         *
+         * @param[in] messageId Id of the message to download.
+         * @param[in] lines Number of body lines to include.
+         * @param[in] sink Where to put the message.
+         * @return void
+         */
+        void retrieveTop(int messageId, unsigned lines, MessageSink* sink);
+
+        /**
+         * @brief Download several messages into a sink.
+         *
+         *  The RETR commands are pipelined: they are sent ahead as
+         *  long as the messages they request fit in the window (see
+         *  PipelineWindow), and more are sent as the messages arrive,
+         *  so the link doesn't idle between them. The window adapts
+         *  to the link during the session. The messages are passed to
+         *  the \c sink one after another in the order of \c messages.
+         *
+         *  When the server refuses some of the messages, the rest
+         *  of the batch is still received. The ids of the refused
+         *  messages are stored to \c failed if it's given, otherwise
+         *  ServerError is thrown at the end.
          *
-         *  Retrieve a list of available messages and print it.
-         *  This method issues LIST command to the server.
+         * @param[in] messages Messages to download.
+         * @param[in] sink Where to put the messages.
+         * @param[out] failed Ids of messages that weren't retrieved.
+         * @return void
+         */
+        void retrieveMessages(std::vector<MessageInfo> const& messages, MessageSink* sink,
+                              std::vector<int>* failed = NULL);
+
+        /**
+         * @brief Download headers of several messages into a sink.
          *
-         *  Prints a notice when no messages are available.
+         *  Same as retrieveMessages() with "TOP <id> 0" instead of
+         *  RETR. TOP is optional in RFC 1939; when the profile says
+         *  the server doesn't support it, nothing is sent and all
+         *  the messages are reported as failed.
          *
+         * @param[in] messages Messages whose headers to download.
+         * @param[in] sink Where to put the headers.
+         * @param[out] failed Ids of messages without headers.
          * @return void
          */
-        void printMessageList();
+        void retrieveHeaders(std::vector<MessageInfo> const& messages, MessageSink* sink,
+                             std::vector<int>* failed);
 
         /**
-         * @brief Print message by it's ID.
+         * @brief Mark messages for deletion.
          *
-         *  This method downloads and prints a message specified
-         *  by a message ID.
+         *  All the DELE commands are sent at once. The server deletes
+         *  the messages only when the session ends properly, see quit().
+         *
+         * @param[in] messageIds Messages to delete.
+         * @param[out] failed Ids of messages the server refused to mark.
+         * @return void
+         */
+        void deleteMessages(std::vector<int> const& messageIds, std::vector<int>* failed);
+
+        /**
+         * @brief End the session.
+         *
+         *  Sends QUIT and checks the reply. The server removes the
+         *  messages marked for deletion only when QUIT succeeds.
+         *
+         * @return void
+         */
+        void quit();
+
+        /**
+         * @brief Write raw message to a file descriptor.
+         *
+         *  The message is written as it is stored on the server
+         *  (with \r\n line endings). The data are only peeked at
+         *  to find the terminating line and the byte-stuffed dots;
+         *  everything in between is moved from the socket to
+         *  \c fileDescriptor by the kernel without being copied
+         *  through user-space.
          *
          * @param[in] messageId Id of the message to download.
+         * @param[in] fileDescriptor Where to write the message.
          * @return void
          */
-        void printMessage(int messageId);
+        void dumpMessage(int messageId, int fileDescriptor);
 
         /* Exceptions */
         class ServerError;
 
     private:
-        struct ServerResponse;
-
         /**
          * @brief Send POP3 command.
          *
-         *  Sends \c command to the remote server. The command consists of
-         *  a keyword and a set of parameters. The \\r\\n to confirm
-         *  the command is added to the string automatically within this
-         *  method.
+         *  Sends command consisting of a \c keyword and the arguments
+         *  to the remote server. The command is formatted in a reused
+         *  buffer and the \\r\\n to confirm the command is added
+         *  automatically within this method. Commands sent one after
+         *  another go out together when the reply is awaited.
          *
-         * @param[in] command POP3 command to the server.
+         * @param[in] keyword POP3 command keyword, e.g. "RETR".
+         * @param[in] argument Argument of the command.
          * @return void
          */
-        void sendCommand(std::string const& command);
+        void sendCommand(const char* keyword);
+        void sendCommand(const char* keyword, std::string const& argument);
+        void sendCommand(const char* keyword, int argument);
+        void sendCommand(const char* keyword, int argument, unsigned secondArgument);
+
+        void appendNumber(long number);
+        void finishCommand();
+
+        /**
+         * @brief Feed the parser until it reports an event.
+         *
+         *  The parser reads the data in place, from the socket's
+         *  read-ahead buffer.
+         *
+         * @param[out] event The event.
+         * @return void
+         */
+        void nextEvent(ResponseParser::Event* event);
 
         /**
          * @brief Fetch response from the remote server.
@@ -97,6 +348,17 @@ class Pop3Session
          */
         void getResponse(ServerResponse* response);
 
+        /**
+         * @brief Fetch the greeting of the server.
+         *
+         *  Same as getResponse(), but the greeting answers no command,
+         *  so it fires the greeting probe instead of the response one.
+         *
+         * @param[out] response Server's greeting.
+         * @return void
+         */
+        void getGreeting(ServerResponse* response);
+
         /**
          * @brief Fetch \b multiline data part of the response.
          *
@@ -108,22 +370,35 @@ class Pop3Session
          */
         void getMultilineData(ServerResponse* response);
 
-        void open(std::string const& server, int port);
-        void close();
-};
+        /**
+         * @brief Stream \b multiline data part of the response.
+         *
+         *  Same as getMultilineData() but the data are passed to
+         *  \c sink (with the \r\n line endings) in fragments as
+         *  large as they arrived, instead of being stored.
+         *
+         * @param[in] sink Where to put the data.
+         * @return void
+         */
+        void getMultilineData(MessageSink* sink);
 
-/**
- * @brief Data structure for POP3 server responses.
- *
- *  This is used internaly by Pop3Session to store server's
- *  responses.
- */
-struct Pop3Session::ServerResponse
-{
+        /**
+         * @brief Read one line of \b multiline data.
+         *
+         *  The view points into the socket's buffer (or to an internal
+         *  one when the line arrived in pieces) and it's valid until
+         *  the next line is read.
+         *
+         * @param[out] line The line, un-stuffed and without \r\n.
+         * @return False at the end of the data.
+         */
+        bool getDataLine(std::string_view* line);
 
-    bool status; /*< It's true on +OK, false on -ERR */
-    std::string statusMessage;
-    std::list<std::string> data; /*< Multi-line data in case, they were present. */
+        void parseStatus(MailboxStatus* status);
+        void parseCapabilities();
+
+        void open(std::string const& server, int port);
+        void close();
 };
 
 /**
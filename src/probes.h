@@ -0,0 +1,51 @@
+/**
+ * @brief Static tracepoints
+ *
+ * @file probes.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ *  USDT probes of the pop3client provider, for bpftrace, perf or
+ *  SystemTap (see the scripts in tracing/). A probe is a single nop
+ *  in the code and a note in the ELF file; it costs nothing until a
+ *  tracer attaches to it. The arguments are evaluated even so, so
+ *  they are kept to values that are at hand.
+ *
+ *  The probes are compiled in when <sys/sdt.h> is found (package
+ *  systemtap-sdt-dev or systemtap-sdt-devel), unless NOPROBES=1
+ *  is given to make.
+ *
+ *    connect(address, port, fd)   a socket connected
+ *    receive(fd, bytes)           data read from a socket
+ *    send(fd, bytes)              data written to a socket
+ *    greeting(status, text, length)
+ *                                 the greeting of the server read
+ *    command(keyword, argument)   a command sent (argument is the
+ *                                 message id, 0 for none)
+ *    response(status, text, length)
+ *                                 a status line received, in the
+ *                                 order of the commands (the QUIT
+ *                                 of close() gets none)
+ *    data_end(bytes)              end of multi-line data
+ */
+
+#ifndef _PROBES__H
+#define _PROBES__H
+
+#if !defined(POP3_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define POP3_PROBES
+#endif
+#endif
+
+#ifdef POP3_PROBES
+#define PROBE1(name, a)       DTRACE_PROBE1(pop3client, name, a)
+#define PROBE2(name, a, b)    DTRACE_PROBE2(pop3client, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(pop3client, name, a, b, c)
+#else
+#define PROBE1(name, a)       do {} while (0)
+#define PROBE2(name, a, b)    do {} while (0)
+#define PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @brief Implementation of ResponseBuffer
+ *
+ * @file responsebuffer.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "responsebuffer.h"
+
+#include <string.h>
+
+ResponseBuffer::ResponseBuffer()
+    : used(0)
+{
+    lineOffsets.push_back(0);
+}
+
+void ResponseBuffer::clear()
+{
+    used = 0;
+    lineOffsets.resize(1);
+}
+
+void ResponseBuffer::appendLine(const char* data, size_t length)
+{
+    size_t required = used + length + 2;
+    if (required > storage.size())
+    {
+        /* Grow geometrically; resize() keeps the old content. */
+        size_t newSize = storage.size() > 0 ? storage.size() : 4096;
+        while (newSize < required)
+        {
+            newSize *= 2;
+        }
+        storage.resize(newSize);
+    }
+
+    memcpy(&storage[used], data, length);
+    storage[used + length]     = '\r';
+    storage[used + length + 1] = '\n';
+    used = required;
+
+    lineOffsets.push_back(used);
+}
@@ -0,0 +1,77 @@
+/**
+ * @brief Storage for multiline server responses
+ *
+ * @file responsebuffer.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _RESPONSEBUFFER__H
+#define _RESPONSEBUFFER__H
+
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Arena holding the multiline data of a response.
+ *
+ *  All lines are stored back to back (each terminated by \\r\\n)
+ *  in a single contiguous block, so the block is exactly the
+ *  un-stuffed payload. A table of offsets provides access to
+ *  the individual lines.
+ *
+ *  clear() only rewinds the arena; the memory is kept and reused
+ *  by the next response, so a long-lived buffer stops allocating
+ *  once it has grown to the size of the largest response.
+ */
+class ResponseBuffer
+{
+    std::vector<char> storage;
+    size_t used;
+
+    /* Start of each line plus the end of the last one. */
+    std::vector<size_t> lineOffsets;
+
+    public:
+        ResponseBuffer();
+
+        /**
+         * @brief Drop the content but keep the memory.
+         *
+         * @return void
+         */
+        void clear();
+
+        /**
+         * @brief Append a line.
+         *
+         * @param[in] data Content of the line without the \\r\\n.
+         * @param[in] length Number of bytes in \c data.
+         * @return void
+         */
+        void appendLine(const char* data, size_t length);
+
+        /* Number of lines */
+        size_t size() const { return lineOffsets.size() - 1; }
+        bool empty() const { return size() == 0; }
+
+        /**
+         * @brief Access a line.
+         *
+         *  The view is valid until the buffer is modified.
+         *
+         * @param[in] index Index of the line (from 0 to size() - 1).
+         * @return The line without the \\r\\n.
+         */
+        std::string_view line(size_t index) const
+        {
+            return std::string_view(&storage[0] + lineOffsets[index],
+                                    lineOffsets[index + 1] - lineOffsets[index] - 2);
+        }
+
+        /* The whole payload, lines including their \r\n. */
+        const char* data() const { return storage.empty() ? NULL : &storage[0]; }
+        size_t length() const { return used; }
+};
+
+#endif
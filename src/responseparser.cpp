@@ -0,0 +1,163 @@
+/**
+ * @brief Implementation of ResponseParser
+ *
+ * @file responseparser.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "responseparser.h"
+
+#include <algorithm>
+#include <string.h>
+
+ResponseParser::ResponseParser()
+{
+    reset();
+}
+
+void ResponseParser::reset()
+{
+    state = STATUS_LINE;
+    afterCarriageReturn = false;
+    statusLength = 0;
+}
+
+void ResponseParser::expectData()
+{
+    state = LINE_START;
+    afterCarriageReturn = false;
+}
+
+size_t ResponseParser::parse(const char* data, size_t length, Event* event)
+{
+    event->type = NEED_MORE;
+    event->text = std::string_view();
+
+    if (state == STATUS_LINE)
+    {
+        return parseStatus(data, length, event);
+    }
+    return parseData(data, length, event);
+}
+
+size_t ResponseParser::parseStatus(const char* data, size_t length, Event* event)
+{
+    const char* newline = static_cast<const char*>(memchr(data, '\n', length));
+    size_t consumed = newline != NULL ? newline - data + 1 : length;
+
+    size_t kept = std::min(consumed, MAX_STATUS_LENGTH - statusLength);
+    memcpy(statusLine + statusLength, data, kept);
+    statusLength += kept;
+
+    if (newline == NULL)
+    {
+        return consumed;
+    }
+
+    std::string_view line(statusLine, statusLength);
+    statusLength = 0;
+
+    if (!line.empty() && line.back() == '\n')
+    {
+        line.remove_suffix(1);
+    }
+    if (!line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+
+    /* "+OK text", "-ERR text", or just "+OK" */
+    event->type   = STATUS;
+    event->status = !line.empty() && line[0] == '+';
+
+    size_t space = line.find(' ');
+    line.remove_prefix(space == std::string_view::npos ? line.length() : space + 1);
+    event->text = line;
+
+    return consumed;
+}
+
+size_t ResponseParser::parseData(const char* data, size_t length, Event* event)
+{
+    size_t position = 0;
+    while (position < length)
+    {
+        switch (state)
+        {
+            case LINE_START:
+                if (data[position] == '.')
+                {
+                    position++;
+                    state = DOT;
+                }
+                else
+                {
+                    state = LINE;
+                }
+                break;
+
+            case DOT:
+                if (data[position] == '\r')
+                {
+                    position++;
+                    state = DOT_CR;
+                }
+                else
+                {
+                    state = LINE; /* The dot was stuffed, it's dropped. */
+                }
+                break;
+
+            case DOT_CR:
+                state = LINE;
+                if (data[position] == '\n')
+                {
+                    state = STATUS_LINE;
+                    event->type = END;
+                    return position + 1;
+                }
+
+                /* A stuffed dot again, the \r was data. */
+                afterCarriageReturn = true;
+                event->type = DATA;
+                event->text = std::string_view("\r", 1);
+                return position;
+
+            default: /* LINE */
+            {
+                /* Take everything up to a dot that starts a line. */
+                const char* start = data + position;
+                const char* end   = data + length;
+                const char* scan  = start;
+
+                while (scan < end)
+                {
+                    const char* newline = static_cast<const char*>(memchr(scan, '\n', end - scan));
+                    if (newline == NULL)
+                    {
+                        afterCarriageReturn = end[-1] == '\r';
+                        scan = end;
+                        break;
+                    }
+
+                    bool isLineEnd = newline > start ? newline[-1] == '\r' : afterCarriageReturn;
+                    afterCarriageReturn = false;
+                    scan = newline + 1;
+
+                    if (isLineEnd && (scan == end || *scan == '.'))
+                    {
+                        state = LINE_START;
+                        break;
+                    }
+                }
+
+                event->type = DATA;
+                event->text = std::string_view(start, scan - start);
+                return scan - data;
+            }
+        }
+    }
+
+    return position;
+}
@@ -0,0 +1,115 @@
+/**
+ * @brief Incremental parser of POP3 responses
+ *
+ * @file responseparser.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _RESPONSEPARSER__H
+#define _RESPONSEPARSER__H
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @brief Push parser of the responses of a POP3 server.
+ *
+ *  The parser is fed whatever bytes arrived from the server, in
+ *  chunks of any size, and it reports what it found one event at
+ *  a time. A status line or a terminating ".\r\n" may be split
+ *  between chunks anywhere; the parser carries the state over to
+ *  the next chunk. It never blocks and never allocates memory.
+ *
+ *  The data of a multiline response are reported as fragments
+ *  that point into the chunk. The fragments are un-stuffed and
+ *  keep the \\r\\n line endings, so they are exactly the payload
+ *  as stored on the server. A fragment ends only before a dot
+ *  that starts a line or at the end of the chunk; it usually
+ *  spans many lines.
+ *
+ *  Whether data follow a status line depends on the command, so
+ *  the caller tells the parser with expectData() after a positive
+ *  status of a multiline command (e.g. RETR, LIST or CAPA).
+ */
+class ResponseParser
+{
+    public:
+        enum EventType
+        {
+            NEED_MORE, /*< The chunk was used up without an event */
+            STATUS,    /*< A status line */
+            DATA,      /*< A fragment of multiline data */
+            END        /*< The end of multiline data */
+        };
+
+        struct Event
+        {
+            EventType type;
+            bool status;           /*< STATUS only, true on +OK */
+
+            /* The status message (without "+OK" or "-ERR") or the data
+               fragment. A fragment points into the chunk, except for
+               the \r of a line that started with ".\r" followed by
+               something else than \n. Valid until the next call of
+               parse(). */
+            std::string_view text;
+        };
+
+        /* Longest status line kept, RFC 2449 allows 512 octets
+           including the \r\n. The rest of a longer line is dropped. */
+        static const size_t MAX_STATUS_LENGTH = 512;
+
+    private:
+        enum State
+        {
+            STATUS_LINE,
+            LINE_START,
+            LINE,
+            DOT,        /*< A dot started a line */
+            DOT_CR      /*< ".\r" started a line */
+        };
+
+        State state;
+        bool afterCarriageReturn; /*< The last byte of data was \r */
+
+        char statusLine[MAX_STATUS_LENGTH];
+        size_t statusLength;
+
+    public:
+        ResponseParser();
+
+        /**
+         * @brief Forget any partial response, e.g. for a new connection.
+         *
+         * @return void
+         */
+        void reset();
+
+        /**
+         * @brief Multiline data follow the status line just parsed.
+         *
+         * @return void
+         */
+        void expectData();
+
+        /**
+         * @brief Parse the next part of a chunk.
+         *
+         *  Parsing stops right after the first event, so a status line
+         *  is consumed without the data that follow it. Call parse()
+         *  again with the rest of the chunk until it's used up.
+         *
+         * @param[in] data The chunk.
+         * @param[in] length Number of bytes in \c data.
+         * @param[out] event What was found.
+         * @return Number of bytes consumed.
+         */
+        size_t parse(const char* data, size_t length, Event* event);
+
+    private:
+        size_t parseStatus(const char* data, size_t length, Event* event);
+        size_t parseData(const char* data, size_t length, Event* event);
+};
+
+#endif
@@ -0,0 +1,162 @@
+/**
+ * @brief Implementation of ScanListing
+ *
+ * @file scanlisting.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "scanlisting.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace
+{
+    /* Parse "<number> " from the beginning of text. */
+    template <typename Number>
+    bool parseNumber(const char** position, const char* end, Number* number)
+    {
+        std::from_chars_result result = std::from_chars(*position, end, *number);
+        if (result.ec != std::errc())
+        {
+            return false;
+        }
+
+        *position = result.ptr;
+        while (*position < end && **position == ' ')
+        {
+            (*position)++;
+        }
+
+        return true;
+    }
+}
+
+ScanListing::ScanListing()
+    : totalSize(0), uidCursor(0)
+{}
+
+void ScanListing::clear()
+{
+    ids.clear();
+    sizes.clear();
+    uidOffsets.clear();
+    uidLengths.clear();
+    uidPool.clear();
+
+    totalSize = 0;
+    uidCursor = 0;
+}
+
+void ScanListing::clearUids()
+{
+    std::fill(uidOffsets.begin(), uidOffsets.end(), 0);
+    std::fill(uidLengths.begin(), uidLengths.end(), 0);
+    uidPool.clear();
+
+    uidCursor = 0;
+}
+
+bool ScanListing::parseListLine(std::string_view line)
+{
+    const char* position = line.data();
+    const char* end      = line.data() + line.length();
+
+    int id;
+    size_t size;
+    if (!parseNumber(&position, end, &id) || !parseNumber(&position, end, &size))
+    {
+        return false;
+    }
+
+    add(id, size);
+    return true;
+}
+
+void ScanListing::add(int id, size_t size)
+{
+    ids.push_back(id);
+    sizes.push_back(size);
+    uidOffsets.push_back(0);
+    uidLengths.push_back(0);
+
+    totalSize += size;
+}
+
+bool ScanListing::parseUidLine(std::string_view line)
+{
+    const char* position = line.data();
+    const char* end      = line.data() + line.length();
+
+    int id;
+    if (!parseNumber(&position, end, &id) || position == end)
+    {
+        return false;
+    }
+
+    /* Both lists are ordered by message id. */
+    while (uidCursor < ids.size() && ids[uidCursor] < id)
+    {
+        uidCursor++;
+    }
+
+    if (uidCursor < ids.size() && ids[uidCursor] == id)
+    {
+        uidOffsets[uidCursor] = uidPool.length();
+        uidLengths[uidCursor] = end - position;
+        uidPool.append(position, end);
+    }
+
+    return true;
+}
+
+size_t ScanListing::find(int id) const
+{
+    std::vector<int>::const_iterator position = std::lower_bound(ids.begin(), ids.end(), id);
+    if (position == ids.end() || *position != id)
+    {
+        return ids.size();
+    }
+
+    return position - ids.begin();
+}
+
+size_t ScanListing::findUid(std::string_view uid) const
+{
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        if (getUid(i) == uid)
+        {
+            return i;
+        }
+    }
+
+    return ids.size();
+}
+
+MessageInfo ScanListing::getMessageInfo(size_t index) const
+{
+    MessageInfo message(ids[index], sizes[index]);
+    message.uid.assign(getUid(index));
+
+    return message;
+}
+
+void ScanListing::formatIds(std::string* output) const
+{
+    size_t start = output->length();
+
+    /* At most 10 digits and a newline per id. */
+    output->resize(start + ids.size() * 12);
+
+    char* position = &(*output)[start];
+    char* end      = &(*output)[0] + output->length();
+    for (std::vector<int>::const_iterator id = ids.begin(); id != ids.end(); id++)
+    {
+        position = std::to_chars(position, end, *id).ptr;
+        *position++ = '\n';
+    }
+
+    output->resize(position - output->data());
+}
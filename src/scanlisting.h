@@ -0,0 +1,141 @@
+/**
+ * @brief Compact listing of a maildrop
+ *
+ * @file scanlisting.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _SCANLISTING__H
+#define _SCANLISTING__H
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "messageinfo.h"
+
+/**
+ * @brief Ids, sizes and unique ids of all the messages.
+ *
+ *  The listing is kept as a structure of arrays: one array of ids,
+ *  one of sizes and one of offsets into a single pool holding all
+ *  the unique ids back to back. Parsing a LIST or UIDL line appends
+ *  to the arrays without allocating anything per message, and
+ *  clear() keeps the memory for the next listing.
+ *
+ *  The messages are kept in the order of the LIST response, which
+ *  is ordered by id.
+ */
+class ScanListing
+{
+    std::vector<int> ids;
+    std::vector<size_t> sizes;
+
+    /* Unique id of message i is uidPool[uidOffsets[i], uidOffsets[i] + uidLengths[i]). */
+    std::vector<uint32_t> uidOffsets;
+    std::vector<uint32_t> uidLengths;
+    std::string uidPool;
+
+    size_t totalSize;
+    size_t uidCursor; /*< Where the next UIDL line is matched. */
+
+    public:
+        ScanListing();
+
+        /**
+         * @brief Drop the content but keep the memory.
+         *
+         * @return void
+         */
+        void clear();
+
+        /**
+         * @brief Drop the unique ids, keep the messages.
+         *
+         *  Done before the listing is filled from another UIDL
+         *  response.
+         *
+         * @return void
+         */
+        void clearUids();
+
+        /**
+         * @brief Add a message (without unique id).
+         *
+         * @param[in] id Message id, greater than the last one.
+         * @param[in] size Size of the message in octets.
+         * @return void
+         */
+        void add(int id, size_t size);
+
+        /**
+         * @brief Add a message from a line of LIST response.
+         *
+         * @param[in] line "<id> <size>" without the \\r\\n.
+         * @return False when the line is malformed.
+         */
+        bool parseListLine(std::string_view line);
+
+        /**
+         * @brief Set a unique id from a line of UIDL response.
+         *
+         *  The UIDL lines are expected in the order of ids, as the
+         *  server sends them. Lines of unknown messages are ignored.
+         *
+         * @param[in] line "<id> <uid>" without the \\r\\n.
+         * @return False when the line is malformed.
+         */
+        bool parseUidLine(std::string_view line);
+
+        size_t size() const { return ids.size(); }
+        bool empty() const { return ids.empty(); }
+
+        int getId(size_t index) const { return ids[index]; }
+        size_t getSize(size_t index) const { return sizes[index]; }
+        std::string_view getUid(size_t index) const
+        {
+            return std::string_view(uidPool.data() + uidOffsets[index], uidLengths[index]);
+        }
+
+        /* Sum of the sizes of all the messages. */
+        size_t getTotalSize() const { return totalSize; }
+
+        /**
+         * @brief Look up a message by its id.
+         *
+         * @param[in] id Message id.
+         * @return Index of the message or size() when it isn't listed.
+         */
+        size_t find(int id) const;
+
+        /**
+         * @brief Look up a message by its unique id.
+         *
+         * @param[in] uid Unique id.
+         * @return Index of the message or size() when it isn't listed.
+         */
+        size_t findUid(std::string_view uid) const;
+
+        /**
+         * @brief Describe a message for a MessageSink.
+         *
+         * @param[in] index Index of the message.
+         * @return Id, size and unique id of the message.
+         */
+        MessageInfo getMessageInfo(size_t index) const;
+
+        /**
+         * @brief Append the ids, one per line.
+         *
+         *  The whole listing is formatted into \c output, so it can
+         *  be written out at once.
+         *
+         * @param[out] output Where to append the text.
+         * @return void
+         */
+        void formatIds(std::string* output) const;
+};
+
+#endif
@@ -0,0 +1,649 @@
+/**
+ * @brief Implementation of SearchIndex
+ *
+ * @file searchindex.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "searchindex.h"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_set>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    const char SEGMENT_MAGIC[8] = "P3IDX01";
+
+    struct SegmentHeader
+    {
+        char magic[8];
+        uint32_t documentCount;
+        uint32_t termCount;
+        uint64_t postingsOffset;
+        uint64_t stringsOffset;
+        uint64_t termsOffset;
+        uint64_t documentsOffset;
+        uint64_t size;
+    };
+
+    struct TermEntry
+    {
+        uint64_t postingsOffset;
+        uint32_t postingsLength;
+        uint32_t documentFrequency;
+        uint32_t wordOffset;
+        uint32_t wordLength;
+    };
+
+    struct DocumentEntry
+    {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+    };
+
+    void makeDirectory(std::string const& path)
+    {
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            throw SearchIndex::IndexError("Unable to create directory", path);
+        }
+    }
+
+    void writeAll(int fileDescriptor, const char* data, size_t length, std::string const& path)
+    {
+        while (length > 0)
+        {
+            ssize_t bytesWritten = ::write(fileDescriptor, data, length);
+            if (bytesWritten < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw SearchIndex::IndexError("Unable to write index", path);
+            }
+
+            data   += bytesWritten;
+            length -= bytesWritten;
+        }
+    }
+
+    void encodeNumber(uint32_t number, std::string* output)
+    {
+        while (number >= 0x80)
+        {
+            *output += static_cast<char>(number | 0x80);
+            number >>= 7;
+        }
+        *output += static_cast<char>(number);
+    }
+
+    uint32_t decodeNumber(const unsigned char** position, const unsigned char* end)
+    {
+        uint32_t number = 0;
+        for (unsigned shift = 0; *position < end && shift < 35; shift += 7)
+        {
+            unsigned char byte = *(*position)++;
+            number |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        return number;
+    }
+
+    /**
+     * @brief Writes a segment file.
+     *
+     *  The words must be added in sorted order. The segment appears
+     *  under its name only when it's complete.
+     */
+    class SegmentWriter
+    {
+        static const size_t OUTPUT_BUFFER_SIZE = 1024 * 1024;
+
+        std::string path;
+        std::string temporaryPath;
+        int fileDescriptor;
+
+        std::string output;
+        uint64_t offset;
+
+        std::string strings;
+        std::vector<TermEntry> terms;
+        std::string postings;
+
+        public:
+            SegmentWriter(std::string const& segmentPath)
+                : path(segmentPath), temporaryPath(segmentPath + ".tmp"),
+                  offset(sizeof(SegmentHeader))
+            {
+                fileDescriptor = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fileDescriptor < 0)
+                {
+                    throw SearchIndex::IndexError("Unable to create index segment", temporaryPath);
+                }
+
+                /* The header is written when the offsets are known. */
+                output.assign(sizeof(SegmentHeader), '\0');
+            }
+
+            ~SegmentWriter()
+            {
+                if (fileDescriptor >= 0)
+                {
+                    ::close(fileDescriptor);
+                    unlink(temporaryPath.c_str());
+                }
+            }
+
+            void addTerm(std::string_view word, std::vector<uint32_t> const& documents)
+            {
+                postings.clear();
+
+                uint32_t previous = 0;
+                for (size_t i = 0; i < documents.size(); i++)
+                {
+                    encodeNumber(documents[i] - previous, &postings);
+                    previous = documents[i];
+                }
+
+                TermEntry term;
+                term.postingsOffset    = offset;
+                term.postingsLength    = postings.length();
+                term.documentFrequency = documents.size();
+                term.wordOffset        = strings.length();
+                term.wordLength        = word.length();
+                terms.push_back(term);
+
+                strings.append(word);
+                append(postings.data(), postings.length());
+            }
+
+            void finish(std::vector<std::string_view> const& keys)
+            {
+                std::vector<DocumentEntry> documents(keys.size());
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    documents[i].keyOffset = strings.length();
+                    documents[i].keyLength = keys[i].length();
+                    strings.append(keys[i]);
+                }
+
+                SegmentHeader header;
+                memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+                header.documentCount  = keys.size();
+                header.termCount      = terms.size();
+                header.postingsOffset = sizeof(SegmentHeader);
+
+                header.stringsOffset = offset;
+                append(strings.data(), strings.length());
+                align();
+
+                header.termsOffset = offset;
+                append(reinterpret_cast<const char*>(terms.data()), terms.size() * sizeof(TermEntry));
+
+                header.documentsOffset = offset;
+                append(reinterpret_cast<const char*>(documents.data()), documents.size() * sizeof(DocumentEntry));
+
+                header.size = offset;
+                writeAll(fileDescriptor, output.data(), output.length(), temporaryPath);
+                output.clear();
+
+                if (pwrite(fileDescriptor, &header, sizeof(header), 0) != sizeof(header) ||
+                    fsync(fileDescriptor) != 0)
+                {
+                    throw SearchIndex::IndexError("Unable to write index", temporaryPath);
+                }
+
+                ::close(fileDescriptor);
+                fileDescriptor = -1;
+
+                if (rename(temporaryPath.c_str(), path.c_str()) != 0)
+                {
+                    unlink(temporaryPath.c_str());
+                    throw SearchIndex::IndexError("Unable to store index segment", path);
+                }
+            }
+
+        private:
+            void append(const char* data, size_t length)
+            {
+                output.append(data, length);
+                offset += length;
+
+                if (output.length() >= OUTPUT_BUFFER_SIZE)
+                {
+                    writeAll(fileDescriptor, output.data(), output.length(), temporaryPath);
+                    output.clear();
+                }
+            }
+
+            /* The tables are read in place, so they must be aligned. */
+            void align()
+            {
+                static const char padding[8] = {0};
+                append(padding, (8 - offset % 8) % 8);
+            }
+    };
+}
+
+/**
+ * @brief Read-only view of a memory-mapped segment.
+ */
+class SearchIndex::Segment
+{
+    std::string path;
+    unsigned number;
+
+    const char* data;
+    size_t size;
+
+    SegmentHeader const* header;
+    TermEntry const* terms;
+    DocumentEntry const* documents;
+    const char* strings;
+
+    public:
+        Segment(std::string const& segmentPath, unsigned segmentNumber)
+            : path(segmentPath), number(segmentNumber), data(NULL), size(0)
+        {
+            int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+            if (fileDescriptor < 0)
+            {
+                throw IndexError("Unable to open index segment", path);
+            }
+
+            struct stat info;
+            if (fstat(fileDescriptor, &info) == 0 && info.st_size >= (off_t) sizeof(SegmentHeader))
+            {
+                size = info.st_size;
+                void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+                data = mapping == MAP_FAILED ? NULL : static_cast<const char*>(mapping);
+            }
+            ::close(fileDescriptor);
+
+            header = reinterpret_cast<SegmentHeader const*>(data);
+            if (data == NULL || memcmp(header->magic, SEGMENT_MAGIC, sizeof(header->magic)) != 0 ||
+                header->size != size ||
+                header->termsOffset + uint64_t(header->termCount) * sizeof(TermEntry) > size ||
+                header->documentsOffset + uint64_t(header->documentCount) * sizeof(DocumentEntry) > size)
+            {
+                if (data != NULL)
+                {
+                    munmap(const_cast<char*>(data), size);
+                }
+                throw IndexError("Corrupted index segment", path);
+            }
+
+            terms     = reinterpret_cast<TermEntry const*>(data + header->termsOffset);
+            documents = reinterpret_cast<DocumentEntry const*>(data + header->documentsOffset);
+            strings   = data + header->stringsOffset;
+        }
+
+        ~Segment()
+        {
+            munmap(const_cast<char*>(data), size);
+        }
+
+        std::string const& getPath() const { return path; }
+        unsigned getNumber() const { return number; }
+        uint32_t getDocumentCount() const { return header->documentCount; }
+        uint32_t getTermCount() const { return header->termCount; }
+
+        std::string_view getWord(size_t term) const
+        {
+            return std::string_view(strings + terms[term].wordOffset, terms[term].wordLength);
+        }
+
+        std::string_view getKey(uint32_t document) const
+        {
+            return std::string_view(strings + documents[document].keyOffset, documents[document].keyLength);
+        }
+
+        uint32_t getDocumentFrequency(size_t term) const { return terms[term].documentFrequency; }
+
+        /* Index of the word in the terms table, getTermCount() when it's missing. */
+        size_t find(std::string_view word) const
+        {
+            size_t low = 0;
+            size_t high = header->termCount;
+            while (low < high)
+            {
+                size_t middle = low + (high - low) / 2;
+                if (getWord(middle) < word)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+
+            if (low < header->termCount && getWord(low) == word)
+            {
+                return low;
+            }
+            return header->termCount;
+        }
+
+        /* Append document numbers of a term, shifted by base. */
+        void getPostings(size_t term, uint32_t base, std::vector<uint32_t>* result) const
+        {
+            const unsigned char* position = reinterpret_cast<const unsigned char*>(data + terms[term].postingsOffset);
+            const unsigned char* end      = position + terms[term].postingsLength;
+
+            uint32_t document = 0;
+            while (position < end)
+            {
+                document += decodeNumber(&position, end);
+                result->push_back(base + document);
+            }
+        }
+};
+
+SearchIndex::SearchIndex(std::string const& path)
+    : directory(path), nextSegmentNumber(1)
+{
+    makeDirectory(directory);
+    load();
+}
+
+SearchIndex::~SearchIndex()
+{
+    for (std::vector<Segment*>::iterator segment = segments.begin(); segment != segments.end(); segment++)
+    {
+        delete *segment;
+    }
+}
+
+std::string SearchIndex::getSegmentPath(unsigned number) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/segment-%08u", number);
+
+    return directory + name;
+}
+
+void SearchIndex::load()
+{
+    DIR* listing = opendir(directory.c_str());
+    if (listing == NULL)
+    {
+        throw IndexError("Unable to open index", directory);
+    }
+
+    std::vector<unsigned> numbers;
+    struct dirent* entry;
+    while ((entry = readdir(listing)) != NULL)
+    {
+        unsigned number;
+        char suffix;
+        int fields = sscanf(entry->d_name, "segment-%8u%c", &number, &suffix);
+        if (fields == 1)
+        {
+            numbers.push_back(number);
+        }
+        else if (fields == 2 && suffix == '.') /* Unfinished segment */
+        {
+            unlink((directory + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(listing);
+
+    std::sort(numbers.begin(), numbers.end());
+    for (size_t i = 0; i < numbers.size(); i++)
+    {
+        segments.push_back(new Segment(getSegmentPath(numbers[i]), numbers[i]));
+        nextSegmentNumber = numbers[i] + 1;
+    }
+}
+
+void SearchIndex::addDocument(std::string const& key, std::vector<std::string> const& words)
+{
+    uint32_t document = pendingKeys.size();
+    pendingKeys.push_back(key);
+
+    for (std::vector<std::string>::const_iterator word = words.begin(); word != words.end(); word++)
+    {
+        pendingPostings[*word].push_back(document);
+    }
+}
+
+void SearchIndex::commit()
+{
+    if (pendingKeys.empty())
+    {
+        return;
+    }
+
+    std::string path = getSegmentPath(nextSegmentNumber);
+    SegmentWriter writer(path);
+
+    for (std::map<std::string, std::vector<uint32_t> >::iterator term = pendingPostings.begin();
+         term != pendingPostings.end();
+         term++)
+    {
+        writer.addTerm(term->first, term->second);
+    }
+
+    std::vector<std::string_view> keys(pendingKeys.begin(), pendingKeys.end());
+    writer.finish(keys);
+
+    segments.push_back(new Segment(path, nextSegmentNumber));
+    nextSegmentNumber++;
+
+    pendingKeys.clear();
+    pendingPostings.clear();
+
+    merge();
+}
+
+void SearchIndex::merge()
+{
+    /* Take the newest segments while the older one isn't at
+       least twice as large as all the newer ones together. */
+    size_t first = segments.size() - 1;
+    uint64_t documentCount = segments[first]->getDocumentCount();
+    while (first > 0 && segments[first - 1]->getDocumentCount() < 2 * documentCount)
+    {
+        first--;
+        documentCount += segments[first]->getDocumentCount();
+    }
+
+    if (first == segments.size() - 1)
+    {
+        return;
+    }
+
+    /* K-way merge of the sorted terms tables. */
+    typedef std::pair<size_t, size_t> Cursor; /* segment, term */
+
+    std::vector<uint32_t> bases;
+    uint32_t base = 0;
+    for (size_t i = first; i < segments.size(); i++)
+    {
+        bases.push_back(base);
+        base += segments[i]->getDocumentCount();
+    }
+
+    std::vector<Segment*> const& inputs = segments;
+    auto isAfter = [&inputs](Cursor const& left, Cursor const& right)
+    {
+        std::string_view leftWord  = inputs[left.first]->getWord(left.second);
+        std::string_view rightWord = inputs[right.first]->getWord(right.second);
+        return leftWord != rightWord ? leftWord > rightWord : left.first > right.first;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(isAfter)> cursors(isAfter);
+
+    for (size_t i = first; i < segments.size(); i++)
+    {
+        if (segments[i]->getTermCount() > 0)
+        {
+            cursors.push(Cursor(i, 0));
+        }
+    }
+
+    std::string path = getSegmentPath(nextSegmentNumber);
+    SegmentWriter writer(path);
+
+    std::vector<uint32_t> documents;
+    while (!cursors.empty())
+    {
+        std::string_view word = segments[cursors.top().first]->getWord(cursors.top().second);
+
+        /* Segments come in order, so the numbers stay sorted. */
+        documents.clear();
+        while (!cursors.empty() && segments[cursors.top().first]->getWord(cursors.top().second) == word)
+        {
+            Cursor cursor = cursors.top();
+            cursors.pop();
+
+            segments[cursor.first]->getPostings(cursor.second, bases[cursor.first - first], &documents);
+
+            if (cursor.second + 1 < segments[cursor.first]->getTermCount())
+            {
+                cursors.push(Cursor(cursor.first, cursor.second + 1));
+            }
+        }
+
+        writer.addTerm(word, documents);
+    }
+
+    std::vector<std::string_view> keys;
+    for (size_t i = first; i < segments.size(); i++)
+    {
+        for (uint32_t document = 0; document < segments[i]->getDocumentCount(); document++)
+        {
+            keys.push_back(segments[i]->getKey(document));
+        }
+    }
+    writer.finish(keys);
+
+    /* The merged segment is complete, the inputs can go. A crash
+       in between leaves duplicates, which search() tolerates. */
+    for (size_t i = first; i < segments.size(); i++)
+    {
+        unlink(segments[i]->getPath().c_str());
+        delete segments[i];
+    }
+    segments.resize(first);
+
+    segments.push_back(new Segment(path, nextSegmentNumber));
+    nextSegmentNumber++;
+}
+
+void SearchIndex::search(std::string const& query, std::vector<std::string>* keys) const
+{
+    std::vector<std::string> words;
+    TextExtractor::tokenize(query, &words);
+
+    if (words.empty())
+    {
+        return;
+    }
+
+    std::unordered_set<std::string_view> reported;
+    std::vector<uint32_t> matches;
+    std::vector<uint32_t> postings;
+    std::vector<uint32_t> intersection;
+
+    for (std::vector<Segment*>::const_iterator segment = segments.begin(); segment != segments.end(); segment++)
+    {
+        /* Start with the rarest word to keep the candidates few. */
+        std::vector<std::pair<uint32_t, size_t> > terms;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            size_t term = (*segment)->find(words[i]);
+            if (term == (*segment)->getTermCount())
+            {
+                terms.clear();
+                break;
+            }
+            terms.push_back(std::make_pair((*segment)->getDocumentFrequency(term), term));
+        }
+
+        if (terms.empty())
+        {
+            continue;
+        }
+        std::sort(terms.begin(), terms.end());
+
+        matches.clear();
+        (*segment)->getPostings(terms[0].second, 0, &matches);
+
+        for (size_t i = 1; i < terms.size() && !matches.empty(); i++)
+        {
+            postings.clear();
+            (*segment)->getPostings(terms[i].second, 0, &postings);
+
+            intersection.clear();
+            std::set_intersection(matches.begin(), matches.end(), postings.begin(), postings.end(),
+                                  std::back_inserter(intersection));
+            matches.swap(intersection);
+        }
+
+        for (std::vector<uint32_t>::iterator document = matches.begin(); document != matches.end(); document++)
+        {
+            std::string_view key = (*segment)->getKey(*document);
+            if (reported.insert(key).second)
+            {
+                keys->push_back(std::string(key));
+            }
+        }
+    }
+}
+
+IndexingSink::IndexingSink(SearchIndex* searchIndex, MessageSink* storage)
+    : index(searchIndex), sink(storage)
+{}
+
+void IndexingSink::begin(MessageInfo const& message)
+{
+    key = message.uid.empty() ? std::to_string(message.id) : message.uid;
+
+    extractor.begin();
+    sink->begin(message);
+}
+
+void IndexingSink::write(const char* data, size_t length)
+{
+    sink->write(data, length);
+    extractor.write(data, length);
+}
+
+void IndexingSink::end()
+{
+    sink->end();
+
+    extractor.end(&words);
+    finished.push_back(std::make_pair(key, words));
+}
+
+void IndexingSink::commit()
+{
+    sink->commit();
+
+    for (size_t i = 0; i < finished.size(); i++)
+    {
+        index->addDocument(finished[i].first, finished[i].second);
+    }
+    index->commit();
+
+    finished.clear();
+}
@@ -0,0 +1,144 @@
+/**
+ * @brief Full-text index of saved messages
+ *
+ * @file searchindex.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _SEARCHINDEX__H
+#define _SEARCHINDEX__H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+#include "messagesink.h"
+#include "textextractor.h"
+
+/**
+ * @brief On-disk inverted index.
+ *
+ *  The index maps words to the documents (messages) that contain
+ *  them. It's a directory of immutable segment files, each of them
+ *  covering the documents added between two commits:
+ *
+ *    header     counts and offsets of the other parts
+ *    postings   document numbers of each word, delta and varint coded
+ *    strings    the words and the document keys, back to back
+ *    terms      sorted table of words and their postings
+ *    documents  table of document keys
+ *
+ *  The segments are memory-mapped for searching; a word is found by
+ *  binary search in the terms table. To keep the number of segments
+ *  logarithmic, a new segment is merged with its predecessors while
+ *  they have less than twice as many documents.
+ *
+ *  Adding a document that is already indexed (e.g. a message that
+ *  was downloaded again) doesn't remove the old copy; search results
+ *  are reported once per key.
+ */
+class SearchIndex
+{
+    class Segment;
+
+    std::string directory;
+    std::vector<Segment*> segments;
+    unsigned nextSegmentNumber;
+
+    /* Documents added since the last commit */
+    std::vector<std::string> pendingKeys;
+    std::map<std::string, std::vector<uint32_t> > pendingPostings;
+
+    public:
+        /**
+         * @brief Open (or create) an index.
+         *
+         * @param[in] path Directory of the index.
+         */
+        SearchIndex(std::string const& path);
+        ~SearchIndex();
+
+        /**
+         * @brief Add a document.
+         *
+         *  The document is searchable after commit().
+         *
+         * @param[in] key Identification of the document.
+         * @param[in] words Distinct words of the document.
+         * @return void
+         */
+        void addDocument(std::string const& key, std::vector<std::string> const& words);
+
+        /**
+         * @brief Write the documents added since the last commit.
+         *
+         * @return void
+         */
+        void commit();
+
+        /**
+         * @brief Find documents that contain all the words of a query.
+         *
+         * @param[in] query Words to look for, split by TextExtractor::tokenize().
+         * @param[out] keys Keys of the matching documents, oldest first.
+         * @return void
+         */
+        void search(std::string const& query, std::vector<std::string>* keys) const;
+
+        /* Exceptions */
+        class IndexError;
+
+    private:
+        void load();
+        void merge();
+        std::string getSegmentPath(unsigned number) const;
+};
+
+/**
+ * @brief Adds messages to a SearchIndex as they pass.
+ *
+ *  A decorator that passes the message on to another sink and
+ *  extracts its words on the way. The messages are added to the
+ *  index in commit(), after the other sink committed them. The
+ *  messages are identified by their unique ids (or by their ids
+ *  when the server doesn't support UIDL).
+ */
+class IndexingSink : public MessageSink
+{
+    SearchIndex* index;
+    MessageSink* sink;
+
+    TextExtractor extractor;
+    std::string key;
+    std::vector<std::string> words;
+
+    /* Ended, but not committed messages */
+    std::vector<std::pair<std::string, std::vector<std::string> > > finished;
+
+    public:
+        IndexingSink(SearchIndex* searchIndex, MessageSink* storage);
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+        void commit();
+};
+
+/**
+ * @brief Indicates that the index can't be read or written.
+ */
+class SearchIndex::IndexError : public Error
+{
+    public:
+        IndexError(std::string const& issue, std::string const& path)
+        {
+            problem = issue;
+            reason  = path;
+        }
+};
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * @brief Implementation of ServerProfile and ProfileCache
+ *
+ * @file serverprofile.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "config.h"
+#include "serverprofile.h"
+#include "crc32c.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+namespace
+{
+    /* Create all the missing directories on the way to a file. */
+    void makeParentDirectories(std::string const& path)
+    {
+        for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+        {
+            std::string directory = path.substr(0, slash);
+            if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                throw ProfileCache::CacheError("Unable to create directory", directory);
+            }
+        }
+    }
+
+    /* The keyword of a CAPA line, e.g. "SASL" of "SASL PLAIN" */
+    bool isCapability(std::string const& line, std::string const& name)
+    {
+        return line.length() >= name.length() &&
+               strncasecmp(line.c_str(), name.c_str(), name.length()) == 0 &&
+               (line.length() == name.length() || line[name.length()] == ' ');
+    }
+}
+
+ServerProfile::ServerProfile()
+    : greeting(0), discovered(0), capaSupported(false), roundTripTime(0)
+{}
+
+bool ServerProfile::isFresh(time_t now) const
+{
+    return discovered != 0 && now >= discovered && now - discovered < __PROFILE_MAX_AGE;
+}
+
+bool ServerProfile::hasCapability(std::string const& name) const
+{
+    for (std::vector<std::string>::const_iterator line = capabilities.begin(); line != capabilities.end(); line++)
+    {
+        if (isCapability(*line, name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ServerProfile::lacksCapability(std::string const& name) const
+{
+    return discovered != 0 && capaSupported && !hasCapability(name);
+}
+
+void ServerProfile::forgetCapabilities()
+{
+    discovered    = 0;
+    capaSupported = false;
+    capabilities.clear();
+}
+
+void ServerProfile::addRoundTripTime(unsigned sample)
+{
+    if (sample == 0)
+    {
+        return;
+    }
+
+    /* Same weight as TCP gives to its samples */
+    roundTripTime = roundTripTime == 0 ? sample : (7 * roundTripTime + sample) / 8;
+}
+
+uint32_t ServerProfile::getGreetingChecksum(std::string const& greeting)
+{
+    std::string text = greeting;
+
+    size_t start = text.find('<');
+    size_t end   = text.find('>', start);
+    if (start != std::string::npos && end != std::string::npos)
+    {
+        text.erase(start, end - start + 1);
+    }
+
+    Crc32c checksum;
+    checksum.update(text.data(), text.length());
+    return checksum.getValue();
+}
+
+ProfileCache::ProfileCache(std::string const& cachePath)
+    : path(cachePath)
+{
+    load();
+}
+
+std::string ProfileCache::getDefaultPath()
+{
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome != NULL && cacheHome[0] == '/')
+    {
+        return std::string(cacheHome) + "/" + __PROGRAM_NAME + "/servers";
+    }
+
+    const char* home = getenv("HOME");
+    if (home != NULL && home[0] == '/')
+    {
+        return std::string(home) + "/.cache/" + __PROGRAM_NAME + "/servers";
+    }
+
+    return "";
+}
+
+ServerProfile ProfileCache::get(std::string const& hostname, int port) const
+{
+    std::map<std::string, ServerProfile>::const_iterator profile = profiles.find(getKey(hostname, port));
+    if (profile == profiles.end())
+    {
+        return ServerProfile();
+    }
+
+    return profile->second;
+}
+
+void ProfileCache::set(std::string const& hostname, int port, ServerProfile const& profile)
+{
+    profiles[getKey(hostname, port)] = profile;
+}
+
+std::string ProfileCache::getKey(std::string const& hostname, int port)
+{
+    std::stringstream key;
+    key << hostname << " " << port;
+    return key.str();
+}
+
+void ProfileCache::load()
+{
+    /* A missing or damaged cache only means rediscovery. */
+    std::ifstream file(path.c_str());
+
+    ServerProfile* profile = NULL;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::stringstream fields(line);
+        std::string key;
+        if (!(fields >> key) || key[0] == '#')
+        {
+            continue;
+        }
+
+        if (key == "server")
+        {
+            std::string hostname;
+            int port = 0;
+            fields >> hostname >> port;
+            profile = &profiles[getKey(hostname, port)];
+            continue;
+        }
+
+        if (profile == NULL)
+        {
+            continue;
+        }
+
+        if (key == "address")
+        {
+            fields >> profile->address;
+        }
+        else if (key == "greeting")
+        {
+            fields >> std::hex >> profile->greeting;
+        }
+        else if (key == "discovered")
+        {
+            long long discovered = 0;
+            fields >> discovered;
+            profile->discovered = discovered;
+        }
+        else if (key == "rtt")
+        {
+            fields >> profile->roundTripTime;
+        }
+        else if (key == "capa-unsupported")
+        {
+            profile->capaSupported = false;
+        }
+        else if (key == "capa")
+        {
+            std::string capability;
+            std::getline(fields >> std::ws, capability);
+            profile->capabilities.push_back(capability);
+            profile->capaSupported = true;
+        }
+    }
+}
+
+void ProfileCache::save() const
+{
+    if (path.empty())
+    {
+        return;
+    }
+
+    std::stringstream content;
+    content << "# " << __PROGRAM_NAME << " server profiles, safe to delete\n";
+
+    for (std::map<std::string, ServerProfile>::const_iterator entry = profiles.begin();
+         entry != profiles.end();
+         entry++)
+    {
+        ServerProfile const& profile = entry->second;
+
+        content << "server " << entry->first << "\n";
+        if (!profile.address.empty())
+        {
+            content << "address " << profile.address << "\n";
+        }
+        content << "greeting " << std::hex << profile.greeting << std::dec << "\n";
+        content << "discovered " << static_cast<long long>(profile.discovered) << "\n";
+        content << "rtt " << profile.roundTripTime << "\n";
+
+        if (profile.discovered != 0 && !profile.capaSupported)
+        {
+            content << "capa-unsupported\n";
+        }
+        for (std::vector<std::string>::const_iterator capability = profile.capabilities.begin();
+             capability != profile.capabilities.end();
+             capability++)
+        {
+            content << "capa " << *capability << "\n";
+        }
+    }
+
+    makeParentDirectories(path);
+
+    /* Each process has its own temporary file. */
+    std::stringstream temporaryPath;
+    temporaryPath << path << ".tmp." << getpid();
+
+    std::ofstream output(temporaryPath.str().c_str(), std::ios::trunc);
+    output << content.str();
+    output.close();
+
+    if (output.fail() || rename(temporaryPath.str().c_str(), path.c_str()) != 0)
+    {
+        unlink(temporaryPath.str().c_str());
+        throw CacheError("Unable to write server profiles", path);
+    }
+}
@@ -0,0 +1,172 @@
+/**
+ * @brief What is known about POP3 servers from earlier sessions
+ *
+ * @file serverprofile.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _SERVERPROFILE__H
+#define _SERVERPROFILE__H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "error.h"
+
+/**
+ * @brief Facts about a server that a session doesn't have to rediscover.
+ *
+ *  Pop3Session fills the profile in as it learns the facts and uses
+ *  the ones it already has: it connects to the cached address without
+ *  a DNS lookup and doesn't ask for the capabilities (CAPA) again.
+ *  The capabilities are dropped, and discovered again, when the
+ *  server's greeting changes or the profile gets older than
+ *  __PROFILE_MAX_AGE; the address is not used then either.
+ */
+struct ServerProfile
+{
+    std::string address;      /*< Numeric address of the last connection */
+    uint32_t greeting;        /*< Checksum of the greeting, without the APOP timestamp */
+    time_t discovered;        /*< When the capabilities were asked for, 0 never */
+    bool capaSupported;       /*< The server answered CAPA */
+    std::vector<std::string> capabilities; /*< Lines of the CAPA response */
+    unsigned roundTripTime;   /*< Smoothed, in microseconds, 0 unknown */
+
+    ServerProfile();
+
+    /**
+     * @brief The profile is recent enough to be trusted.
+     */
+    bool isFresh(time_t now) const;
+
+    /**
+     * @brief The capabilities are known and \c name is among them.
+     *
+     * @param[in] name Capability keyword, e.g. "PIPELINING".
+     */
+    bool hasCapability(std::string const& name) const;
+
+    /**
+     * @brief The server listed its capabilities and \c name isn't among them.
+     *
+     *  Nothing is known to be lacking when the server refused CAPA:
+     *  servers older than RFC 2449 implement UIDL and TOP without
+     *  advertising them, so the commands are just tried.
+     */
+    bool lacksCapability(std::string const& name) const;
+
+    /**
+     * @brief Forget everything learned from CAPA.
+     *
+     * @return void
+     */
+    void forgetCapabilities();
+
+    /**
+     * @brief Add a round trip time measurement to the average.
+     *
+     * @param[in] sample Measured time in microseconds, 0 is ignored.
+     * @return void
+     */
+    void addRoundTripTime(unsigned sample);
+
+    /**
+     * @brief Checksum of a greeting for the \c greeting field.
+     *
+     *  The APOP timestamp (<...>) differs in each session, so it
+     *  is left out.
+     *
+     * @param[in] greeting Status message of the server's greeting.
+     * @return The checksum.
+     */
+    static uint32_t getGreetingChecksum(std::string const& greeting);
+};
+
+/**
+ * @brief Server profiles saved in a file between runs.
+ *
+ *  The profiles are keyed by the hostname and port as given by the
+ *  user. The file is a list of records, each starting with a
+ *  "server <hostname> <port>" line followed by "<key> <value>" lines:
+ *
+ *    server mail.example.com 110
+ *    address 192.0.2.1
+ *    greeting 7a1c03e2
+ *    discovered 1760000000
+ *    rtt 21500
+ *    capa UIDL
+ *    capa PIPELINING
+ *
+ *  The file is rewritten as a whole by save(). When more processes
+ *  save at once, the last one wins; the others' updates are lost,
+ *  which only costs a rediscovery.
+ */
+class ProfileCache
+{
+    std::string path;
+    std::map<std::string, ServerProfile> profiles;
+
+    public:
+        /**
+         * @param[in] cachePath The file. It doesn't have to exist.
+         */
+        ProfileCache(std::string const& cachePath);
+
+        /**
+         * @brief Default location of the file.
+         *
+         *  $XDG_CACHE_HOME/pop3client/servers or
+         *  $HOME/.cache/pop3client/servers.
+         *
+         * @return The path, empty when neither variable is set.
+         */
+        static std::string getDefaultPath();
+
+        /**
+         * @brief Profile of a server, an empty one when it isn't known.
+         */
+        ServerProfile get(std::string const& hostname, int port) const;
+
+        /**
+         * @brief Replace the profile of a server.
+         *
+         * @return void
+         */
+        void set(std::string const& hostname, int port, ServerProfile const& profile);
+
+        /**
+         * @brief Write the profiles to the file.
+         *
+         *  The directories on the way are created when missing.
+         *
+         * @return void
+         */
+        void save() const;
+
+        /* Exceptions */
+        class CacheError;
+
+    private:
+        void load();
+        static std::string getKey(std::string const& hostname, int port);
+};
+
+/**
+ * @brief Indicates that the cache can't be written.
+ */
+class ProfileCache::CacheError : public Error
+{
+    public:
+        CacheError(std::string const& issue, std::string const& path)
+        {
+            problem = issue;
+            reason  = path;
+        }
+};
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @brief Implementation of Sha256
+ *
+ * @file sha256.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "sha256.h"
+
+#include <string>
+#include <string.h>
+
+namespace
+{
+    const uint32_t ROUND_CONSTANTS[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    inline uint32_t rotateRight(uint32_t value, int bits)
+    {
+        return (value >> bits) | (value << (32 - bits));
+    }
+}
+
+Sha256::Sha256()
+{
+    reset();
+}
+
+void Sha256::reset()
+{
+    state[0] = 0x6a09e667;
+    state[1] = 0xbb67ae85;
+    state[2] = 0x3c6ef372;
+    state[3] = 0xa54ff53a;
+    state[4] = 0x510e527f;
+    state[5] = 0x9b05688c;
+    state[6] = 0x1f83d9ab;
+    state[7] = 0x5be0cd19;
+
+    blockLength = 0;
+    totalLength = 0;
+}
+
+void Sha256::update(const char* data, size_t length)
+{
+    const unsigned char* input = reinterpret_cast<const unsigned char*>(data);
+    totalLength += length;
+
+    /* Complete the partially filled block first. */
+    if (blockLength > 0)
+    {
+        size_t missing = BLOCK_SIZE - blockLength;
+        size_t toCopy  = length < missing ? length : missing;
+
+        memcpy(block + blockLength, input, toCopy);
+        blockLength += toCopy;
+        input       += toCopy;
+        length      -= toCopy;
+
+        if (blockLength < BLOCK_SIZE)
+        {
+            return;
+        }
+
+        processBlock(block);
+        blockLength = 0;
+    }
+
+    /* Whole blocks are processed straight from the input. */
+    while (length >= BLOCK_SIZE)
+    {
+        processBlock(input);
+        input  += BLOCK_SIZE;
+        length -= BLOCK_SIZE;
+    }
+
+    memcpy(block, input, length);
+    blockLength = length;
+}
+
+void Sha256::finish(unsigned char* digest)
+{
+    uint64_t bitLength = totalLength * 8;
+
+    block[blockLength++] = 0x80;
+    if (blockLength > BLOCK_SIZE - 8)
+    {
+        memset(block + blockLength, 0, BLOCK_SIZE - blockLength);
+        processBlock(block);
+        blockLength = 0;
+    }
+
+    memset(block + blockLength, 0, BLOCK_SIZE - 8 - blockLength);
+    for (int i = 0; i < 8; i++)
+    {
+        block[BLOCK_SIZE - 1 - i] = static_cast<unsigned char>(bitLength >> (8 * i));
+    }
+    processBlock(block);
+
+    for (int i = 0; i < 8; i++)
+    {
+        digest[4*i]     = static_cast<unsigned char>(state[i] >> 24);
+        digest[4*i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        digest[4*i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        digest[4*i + 3] = static_cast<unsigned char>(state[i]);
+    }
+}
+
+std::string Sha256::hexDigest()
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    unsigned char digest[DIGEST_SIZE];
+    finish(digest);
+
+    std::string hex;
+    hex.reserve(2 * DIGEST_SIZE);
+    for (size_t i = 0; i < DIGEST_SIZE; i++)
+    {
+        hex += hexDigits[digest[i] >> 4];
+        hex += hexDigits[digest[i] & 0x0f];
+    }
+
+    return hex;
+}
+
+void Sha256::processBlock(const unsigned char* data)
+{
+    uint32_t schedule[64];
+
+    for (int i = 0; i < 16; i++)
+    {
+        schedule[i] = (static_cast<uint32_t>(data[4*i]) << 24) |
+                      (static_cast<uint32_t>(data[4*i + 1]) << 16) |
+                      (static_cast<uint32_t>(data[4*i + 2]) << 8) |
+                       static_cast<uint32_t>(data[4*i + 3]);
+    }
+
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = rotateRight(schedule[i-15], 7) ^ rotateRight(schedule[i-15], 18) ^ (schedule[i-15] >> 3);
+        uint32_t s1 = rotateRight(schedule[i-2], 17) ^ rotateRight(schedule[i-2], 19) ^ (schedule[i-2] >> 10);
+        schedule[i] = schedule[i-16] + s0 + schedule[i-7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t s1    = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        uint32_t ch    = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + ch + ROUND_CONSTANTS[i] + schedule[i];
+        uint32_t s0    = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        uint32_t maj   = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + maj;
+
+        h = g; g = f; f = e; e = d + temp1;
+        d = c; c = b; b = a; a = temp1 + temp2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
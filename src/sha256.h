@@ -0,0 +1,75 @@
+/**
+ * @brief SHA-256 message digest
+ *
+ * @file sha256.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _SHA256__H
+#define _SHA256__H
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * @brief Incremental SHA-256 (FIPS 180-4) computation.
+ *
+ *  The data can be fed in arbitrary chunks, so the digest
+ *  can be computed while the message is still streaming
+ *  from the server.
+ */
+class Sha256
+{
+    public:
+        static const size_t DIGEST_SIZE = 32;
+
+    private:
+        static const size_t BLOCK_SIZE = 64;
+
+        uint32_t state[8];
+        unsigned char block[BLOCK_SIZE];
+        size_t blockLength;
+        uint64_t totalLength;
+
+    public:
+        Sha256();
+
+        /**
+         * @brief Forget everything and start a new digest.
+         *
+         * @return void
+         */
+        void reset();
+
+        /**
+         * @brief Add data to the digest.
+         *
+         * @param[in] data Input data.
+         * @param[in] length Number of bytes in \c data.
+         * @return void
+         */
+        void update(const char* data, size_t length);
+
+        /**
+         * @brief Finish the computation.
+         *
+         *  The object must be reset() before it is used again.
+         *
+         * @param[out] digest Buffer of at least DIGEST_SIZE bytes.
+         * @return void
+         */
+        void finish(unsigned char* digest);
+
+        /**
+         * @brief Finish the computation and return hex encoded digest.
+         *
+         * @return Lowercase hexadecimal digest (64 characters).
+         */
+        std::string hexDigest();
+
+    private:
+        void processBlock(const unsigned char* data);
+};
+
+#endif
@@ -9,14 +9,21 @@
 #include "config.h"
 #include "socket.h"
 #include "error.h"
+#include "probes.h"
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <sstream>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -24,10 +31,21 @@
 #include <unistd.h>
 #include <string.h>
 
+SocketBackend::Type Socket::backendType = SocketBackend::CLASSIC;
+Socket::Options Socket::options;
+
+Socket::Options::Options()
+    : noDelay(true), cork(false), receiveBufferSize(0)
+{}
 
 Socket::Socket(std::string const& inputAddress, std::string const& inputPort)
 {
     socketFileDescriptor = -1;
+    pipeFileDescriptors[0] = pipeFileDescriptors[1] = -1;
+
+    backend = NULL;
+    receiveBuffer.resize(RECEIVE_BUFFER_SIZE);
+    receiveStart = receiveEnd = 0;
 
     address = inputAddress;
     port    = inputPort;
@@ -38,6 +56,11 @@ Socket::Socket(std::string const& inputAddress, std::string const& inputPort)
 Socket::Socket(std::string const& inputAddress, int inputPort)
 {
     socketFileDescriptor = -1;
+    pipeFileDescriptors[0] = pipeFileDescriptors[1] = -1;
+
+    backend = NULL;
+    receiveBuffer.resize(RECEIVE_BUFFER_SIZE);
+    receiveStart = receiveEnd = 0;
 
     std::stringstream portInString;
     portInString << inputPort;
@@ -73,6 +96,14 @@ void Socket::open()
             continue;
         }
 
+        /* The window scale is negotiated on connect,
+           so the buffer has to be sized before. */
+        if (options.receiveBufferSize > 0)
+        {
+            int size = options.receiveBufferSize;
+            setsockopt(socketFileDescriptor, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
         if (connect(socketFileDescriptor, resultPointer->ai_addr, resultPointer->ai_addrlen) != -1)
         {
             break;
@@ -81,12 +112,23 @@ void Socket::open()
         ::close(socketFileDescriptor);
     }
 
+    ::freeaddrinfo(result);
+
     if (resultPointer == NULL)
     {
         throw ConnectionError("Cannot establish connection to the server");
     }
 
-    ::freeaddrinfo(result);
+    if (options.noDelay)
+    {
+        int enabled = 1;
+        setsockopt(socketFileDescriptor, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    }
+
+    backend = SocketBackend::create(backendType, socketFileDescriptor,
+                                    &receiveBuffer[0], receiveBuffer.size(), options.cork);
+
+    PROBE3(connect, address.c_str(), port.c_str(), socketFileDescriptor);
 }
 
 Socket::~Socket()
@@ -99,32 +141,82 @@ Socket::~Socket()
 
 void Socket::close()
 {
+    delete backend; /* Sends whatever it postponed. */
+    backend = NULL;
+
     ::shutdown(socketFileDescriptor, SHUT_RDWR);
     ::close(socketFileDescriptor);
+
+    if (pipeFileDescriptors[0] >= 0)
+    {
+        ::close(pipeFileDescriptors[0]);
+        ::close(pipeFileDescriptors[1]);
+    }
 }
 
-size_t Socket::read(char* buffer, size_t size)
+void Socket::setBackendType(SocketBackend::Type type)
 {
-    if (!isReadyToRead())
+    backendType = type;
+}
+
+SocketBackend::Type Socket::getBackendType() const
+{
+    return backend->getType();
+}
+
+std::string Socket::getPeerAddress() const
+{
+    struct sockaddr_storage peer;
+    socklen_t length = sizeof(peer);
+    char host[NI_MAXHOST];
+
+    if (getpeername(socketFileDescriptor, reinterpret_cast<struct sockaddr*>(&peer), &length) != 0 ||
+        getnameinfo(reinterpret_cast<struct sockaddr*>(&peer), length, host, sizeof(host),
+                    NULL, 0, NI_NUMERICHOST) != 0)
     {
-        throw IOError("Recieving error", "Server not responding (connection timed out).");
+        return "";
     }
 
-    ssize_t bytesRead = ::read(socketFileDescriptor, buffer, size);
-    if (bytesRead < 0)
+    return host;
+}
+
+unsigned Socket::getRoundTripTime() const
+{
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+
+    if (getsockopt(socketFileDescriptor, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
     {
-        throw IOError("Recieving error", "Unable to resolve data from remote host");
+        return 0;
     }
 
-    return bytesRead;
+    return info.tcpi_rtt;
+}
+
+void Socket::setOptions(Options const& socketOptions)
+{
+    options = socketOptions;
 }
 
-void Socket::write(std::string request)
+size_t Socket::read(char* buffer, size_t size)
 {
-    if (::write(socketFileDescriptor, request.c_str(), request.length()) < 0)
+    if (receiveStart == receiveEnd)
     {
-        throw IOError("Sending error", "Unable to send data to remote host");
+        receiveStart = 0;
+        receiveEnd   = receive(&receiveBuffer[0], receiveBuffer.size());
     }
+
+    size_t bytesRead = std::min(size, receiveEnd - receiveStart);
+    memcpy(buffer, &receiveBuffer[receiveStart], bytesRead);
+    receiveStart += bytesRead;
+
+    return bytesRead;
+}
+
+void Socket::write(const char* data, size_t length)
+{
+    PROBE2(send, socketFileDescriptor, length);
+    backend->send(data, length);
 }
 
 void Socket::readAll(std::string *response)
@@ -148,24 +240,265 @@ bool Socket::readCharacter(char* buffer)
 
 size_t Socket::readLine(std::string* line)
 {
-    char buffer[2] = "";
-    *line = "";
+    line->clear();
     size_t bytesRead = 0;
 
-    if (readCharacter(&(buffer[1])))
+    while (true)
+    {
+        if (receiveStart == receiveEnd)
+        {
+            receiveStart = 0;
+            receiveEnd   = receive(&receiveBuffer[0], receiveBuffer.size());
+            if (receiveEnd == 0)
+            {
+                break; /* Connection closed. */
+            }
+        }
+
+        /* Take everything up to the next \n at once. */
+        const char* start   = &receiveBuffer[receiveStart];
+        size_t available    = receiveEnd - receiveStart;
+        const char* newline = static_cast<const char*>(memchr(start, '\n', available));
+        size_t chunk        = newline != NULL ? newline - start + 1 : available;
+
+        line->append(start, chunk);
+        receiveStart += chunk;
+        bytesRead    += chunk;
+
+        size_t length = line->length();
+        if (newline != NULL && length >= 2 && (*line)[length - 2] == '\r')
+        {
+            line->resize(length - 2);
+            break;
+        }
+    }
+
+    return bytesRead;
+}
+
+size_t Socket::peek(char* buffer, size_t size, bool waitAll)
+{
+    backend->flush();
+
+    /* Data that were already read ahead come first. */
+    if (receiveStart < receiveEnd)
+    {
+        if (waitAll && receiveEnd - receiveStart < size)
+        {
+            memmove(&receiveBuffer[0], &receiveBuffer[receiveStart], receiveEnd - receiveStart);
+            receiveEnd  -= receiveStart;
+            receiveStart = 0;
+
+            while (receiveEnd < size)
+            {
+                size_t bytesRead = receive(&receiveBuffer[receiveEnd], size - receiveEnd);
+                if (bytesRead == 0)
+                {
+                    break;
+                }
+                receiveEnd += bytesRead;
+            }
+        }
+
+        size_t buffered = std::min(size, receiveEnd - receiveStart);
+        memcpy(buffer, &receiveBuffer[receiveStart], buffered);
+        return buffered;
+    }
+
+    if (!isReadyToRead())
+    {
+        throw IOError("Recieving error", "Server not responding (connection timed out).");
+    }
+
+    int flags = MSG_PEEK;
+    if (waitAll)
+    {
+        flags |= MSG_WAITALL;
+    }
+
+    ssize_t bytesRead = ::recv(socketFileDescriptor, buffer, size, flags);
+    if (bytesRead < 0)
+    {
+        throw IOError("Recieving error", "Unable to resolve data from remote host");
+    }
+
+    return bytesRead;
+}
+
+std::string_view Socket::fill()
+{
+    if (receiveStart == receiveEnd)
+    {
+        receiveStart = 0;
+        receiveEnd   = receive(&receiveBuffer[0], receiveBuffer.size());
+    }
+
+    return std::string_view(&receiveBuffer[receiveStart], receiveEnd - receiveStart);
+}
+
+void Socket::discard(size_t size)
+{
+    size_t buffered = std::min(size, receiveEnd - receiveStart);
+    receiveStart += buffered;
+    size         -= buffered;
+
+    /* Only the bytes asked for; reading ahead into the buffer
+       would take the data that follow away from transfer(). */
+    char buffer[256];
+    while (size > 0)
+    {
+        size_t bytesRead = receive(buffer, std::min(size, sizeof(buffer)));
+        if (bytesRead == 0)
+        {
+            throw IOError("Recieving error", "Connection closed by remote host");
+        }
+        size -= bytesRead;
+    }
+}
+
+void Socket::transfer(int fileDescriptor, size_t size)
+{
+    size_t buffered = std::min(size, receiveEnd - receiveStart);
+    if (buffered > 0)
+    {
+        writeAll(fileDescriptor, &receiveBuffer[receiveStart], buffered);
+        receiveStart += buffered;
+        size         -= buffered;
+    }
+
+    size_t remaining = splice(fileDescriptor, size);
+    copy(socketFileDescriptor, fileDescriptor, remaining);
+}
+
+size_t Socket::splice(int fileDescriptor, size_t size)
+{
+    struct stat outputInfo;
+    if (fstat(fileDescriptor, &outputInfo) != 0)
+    {
+        return size;
+    }
+
+    /* splice() needs a pipe on one side. When the output is
+       a pipe itself, the data can go there directly. */
+    int target = fileDescriptor;
+    if (!S_ISFIFO(outputInfo.st_mode))
     {
-        do
+        if (pipeFileDescriptors[0] < 0 && pipe(pipeFileDescriptors) != 0)
         {
-            *line     += buffer[0]; // add char to string
-            buffer[0]  = buffer[1];
-            bytesRead++;
+            return size;
         }
-        while (readCharacter(&(buffer[1])) &&
-               !(buffer[0] == '\r' && buffer[1] == '\n'));
-     
-        line->erase(0, 1);
+        target = pipeFileDescriptors[1];
     }
 
+    while (size > 0)
+    {
+        if (!isReadyToRead())
+        {
+            throw IOError("Recieving error", "Server not responding (connection timed out).");
+        }
+
+        ssize_t moved = ::splice(socketFileDescriptor, NULL, target, NULL, size, SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (moved < 0 && errno == EINVAL)
+        {
+            return size; /* Not supported, nothing was moved. */
+        }
+        if (moved < 0)
+        {
+            throw IOError("Recieving error", "Unable to resolve data from remote host");
+        }
+        if (moved == 0)
+        {
+            throw IOError("Recieving error", "Connection closed by remote host");
+        }
+
+        size -= moved;
+        PROBE2(receive, socketFileDescriptor, moved);
+
+        /* Drain the intermediate pipe into the output. */
+        while (target != fileDescriptor && moved > 0)
+        {
+            ssize_t written = ::splice(pipeFileDescriptors[0], NULL, fileDescriptor, NULL, moved, SPLICE_F_MOVE);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written < 0 && errno == EINVAL)
+            {
+                /* The output doesn't support splice(), e.g. a file
+                   opened with O_APPEND. Empty the pipe by hand
+                   and let the caller copy the rest. */
+                copy(pipeFileDescriptors[0], fileDescriptor, moved);
+                return size;
+            }
+            if (written <= 0)
+            {
+                throw IOError("Sending error", "Unable to write the data");
+            }
+            moved -= written;
+        }
+    }
+
+    return 0;
+}
+
+void Socket::copy(int source, int fileDescriptor, size_t size)
+{
+    char buffer[16384];
+
+    while (size > 0)
+    {
+        if (source == socketFileDescriptor && !isReadyToRead())
+        {
+            throw IOError("Recieving error", "Server not responding (connection timed out).");
+        }
+
+        ssize_t bytesRead = ::read(source, buffer, std::min(size, sizeof(buffer)));
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytesRead <= 0)
+        {
+            throw IOError("Recieving error", "Unable to resolve data from remote host");
+        }
+
+        if (source == socketFileDescriptor)
+        {
+            PROBE2(receive, socketFileDescriptor, bytesRead);
+        }
+
+        writeAll(fileDescriptor, buffer, bytesRead);
+        size -= bytesRead;
+    }
+}
+
+void Socket::writeAll(int fileDescriptor, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = ::write(fileDescriptor, data, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            throw IOError("Sending error", "Unable to write the data");
+        }
+        data   += written;
+        length -= written;
+    }
+}
+
+size_t Socket::receive(char* buffer, size_t size)
+{
+    size_t bytesRead = backend->receive(buffer, size);
+    PROBE2(receive, socketFileDescriptor, bytesRead);
+
     return bytesRead;
 }
 
@@ -182,7 +515,13 @@ bool Socket::isReadyToRead()
     timeout.tv_sec = __SOCKET_READ_TIMEOUT;
     timeout.tv_usec = 0;
 
-    selectReturnValue = select(socketFileDescriptor + 1, &recieveFd, NULL, NULL, &timeout);
+    /* Linux leaves the remaining time in the timeout, so a signal
+       doesn't extend the wait. */
+    do
+    {
+        selectReturnValue = select(socketFileDescriptor + 1, &recieveFd, NULL, NULL, &timeout);
+    }
+    while (selectReturnValue < 0 && errno == EINTR);
 
     if (selectReturnValue > 0)
     {
@@ -10,8 +10,11 @@
 #define _SOCKET__H
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "error.h"
+#include "socketbackend.h"
 
 /**
  * @brief Object-oriented BSD socket API wrapper.
@@ -26,19 +29,84 @@ class Socket
     std::string address;
     std::string port;
 
+    /* Intermediate pipe for splice(), created on demand. */
+    int pipeFileDescriptors[2];
+
+    static const size_t RECEIVE_BUFFER_SIZE = 65536;
+
+    /* Data read ahead from the kernel. The bytes between
+       receiveStart and receiveEnd weren't consumed yet. */
+    std::vector<char> receiveBuffer;
+    size_t receiveStart;
+    size_t receiveEnd;
+
+    SocketBackend* backend;
+    static SocketBackend::Type backendType;
+
     public:
+        /**
+         * @brief TCP tuning applied to the sockets opened from now on.
+         */
+        struct Options
+        {
+            bool noDelay;             /*< TCP_NODELAY, on by default */
+            bool cork;                /*< TCP_CORK while flushing commands */
+            size_t receiveBufferSize; /*< SO_RCVBUF, 0 keeps the system default */
+
+            Options();
+        };
+
         //Socket(); /* No default constructor. */
         Socket(std::string const& inputAddress, int inputPort);
         Socket(std::string const& inputAddress, std::string const& inputPort);
         ~Socket();
 
+        /**
+         * @brief Choose I/O backend for sockets opened from now on.
+         *
+         *  The classic backend is the default. When the chosen one
+         *  isn't available, the sockets silently use the classic one.
+         *
+         * @param[in] type The backend.
+         * @return void
+         */
+        static void setBackendType(SocketBackend::Type type);
+
+        /* Backend actually used by this socket. */
+        SocketBackend::Type getBackendType() const;
+
+        /* Numeric address of the remote host. */
+        std::string getPeerAddress() const;
+
+        /**
+         * @brief Round trip time to the remote host.
+         *
+         * @return Smoothed RTT measured by the kernel (TCP_INFO) in
+         *         microseconds, 0 when it isn't available.
+         */
+        unsigned getRoundTripTime() const;
+
+        /**
+         * @brief Choose TCP options for sockets opened from now on.
+         *
+         *  Commands are coalesced by the backends, so Nagle's
+         *  algorithm only delays them; TCP_NODELAY is on unless
+         *  turned off here.
+         *
+         * @param[in] socketOptions The options.
+         * @return void
+         */
+        static void setOptions(Options const& socketOptions);
+
         /** 
          * @brief Read exact number of bytes from the socket.
          *
          *  Reads at most \c size bytes from the socket and
          *  stores them to \c buffer. The buffer's size must
          *  be greater then the \c size, otherwise expect
-         *  some segfaults.
+         *  some segfaults. The socket reads ahead into its
+         *  own buffer, so small reads are served without
+         *  a system call.
          * 
          * @param[out] buffer Where to store the data
          * @param[in] size How many bytes to read
@@ -47,6 +115,19 @@ class Socket
          */
         size_t read(char* buffer, size_t size);
 
+        /**
+         * @brief Send data to remote host.
+         *
+         *  The data are queued and sent together with the other
+         *  queued data right before the socket waits for a reply.
+         *  The data are copied, so \c data can be reused at once.
+         *
+         * @param[in] data What to send
+         * @param[in] length Number of bytes in \c data
+         * @return void
+         */
+        void write(const char* data, size_t length);
+
         /**
          * @brief Send data to remote host.
          *
@@ -56,7 +137,7 @@ class Socket
          * @param[in] request String to write to the socket
          * @return void
          */
-        void write(std::string request);
+        void write(std::string const& request) { write(request.data(), request.length()); }
 
         /**
          * @brief Read all available data from the socket.
@@ -72,8 +153,9 @@ class Socket
         /**
          * @brief Read a single line from socket.
          * 
-         *  This method reads byte-by-byte from the socket until
-         *  \\r\\n is detected or no more data are available.
+         *  This method scans the read-ahead buffer for \\r\\n and
+         *  copies the line out in chunks, refilling the buffer until
+         *  the end of the line or no more data are available.
          *
          * @param [out] line Acquired data.
          * @return Number of bytes read (including the \\r\\n which
@@ -81,12 +163,85 @@ class Socket
          */
         size_t readLine(std::string* line);
 
+        /**
+         * @brief Look at the incoming data without consuming them.
+         *
+         *  Waits until some data are available and copies at most
+         *  \c size bytes of them to \c buffer. The data stay in
+         *  the socket and will be returned by the next read.
+         *
+         * @param[out] buffer Where to store the data
+         * @param[in] size How many bytes to peek at
+         * @param[in] waitAll Wait until all the \c size bytes arrive
+         * @return Number of bytes stored to \c buffer (0 when the
+         *         connection was closed).
+         */
+        size_t peek(char* buffer, size_t size, bool waitAll = false);
+
+        /**
+         * @brief Wait for incoming data and look at them in place.
+         *
+         *  Unlike peek(), nothing is copied: the view points into the
+         *  read-ahead buffer. It stays valid until the next read from
+         *  the socket; consume() tells how much of it was used.
+         *
+         * @return The data read ahead (empty when the connection
+         *         was closed).
+         */
+        std::string_view fill();
+
+        /**
+         * @brief Drop data returned by fill().
+         *
+         * @param[in] size How many bytes were used, at most the
+         *                 length of the view.
+         * @return void
+         */
+        void consume(size_t size) { receiveStart += size; }
+
+        /**
+         * @brief Throw away incoming data.
+         *
+         *  Reads no more than \c size bytes from the socket, so
+         *  the data after them are left for transfer().
+         *
+         * @param[in] size How many bytes to drop
+         * @return void
+         */
+        void discard(size_t size);
+
+        /**
+         * @brief Move incoming data to a file descriptor.
+         *
+         *  The data are moved within the kernel using splice()
+         *  so they never get copied to user-space. When splice()
+         *  isn't possible for \c fileDescriptor (e.g. it's
+         *  a terminal), plain read()/write() is used instead.
+         *
+         * @param[in] fileDescriptor Where to write the data
+         * @param[in] size Exact number of bytes to move
+         * @return void
+         */
+        void transfer(int fileDescriptor, size_t size);
+
+        /**
+         * @brief Write data to a file descriptor, retrying short writes.
+         *
+         * @param[in] fileDescriptor Where to write the data
+         * @param[in] data The data
+         * @param[in] length Number of bytes in \c data
+         * @return void
+         */
+        static void writeAll(int fileDescriptor, const char* data, size_t length);
+
 
         /* Exceptions */
         class ConnectionError;
         class IOError;
 
     private:
+        static Options options;
+
         void open();
         void close();
 
@@ -101,6 +256,13 @@ class Socket
 
         bool isReadyToRead();
 
+        /* Read from the backend (the receive probe fires here). */
+        size_t receive(char* buffer, size_t size);
+
+        /* Helpers of transfer(). splice() returns number
+           of bytes it wasn't able to move. */
+        size_t splice(int fileDescriptor, size_t size);
+        void copy(int source, int fileDescriptor, size_t size);
 };
 
 /**
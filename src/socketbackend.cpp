@@ -0,0 +1,146 @@
+/**
+ * @brief Implementation of the classic Socket backend
+ *
+ * @file socketbackend.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "config.h"
+#include "socketbackend.h"
+#include "iouringbackend.h"
+#include "socket.h"
+
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+
+SocketBackend* SocketBackend::create(Type type, int fileDescriptor,
+                                     char* receiveBuffer, size_t receiveBufferSize,
+                                     bool cork)
+{
+    if (type == IO_URING)
+    {
+        try
+        {
+            return new IoUringBackend(fileDescriptor, receiveBuffer, receiveBufferSize);
+        }
+        catch (Socket::IOError& error)
+        {
+            /* Fall back to the classic backend. */
+        }
+    }
+
+    return new ClassicBackend(fileDescriptor, cork);
+}
+
+ClassicBackend::ClassicBackend(int fileDescriptor, bool corked)
+    : socketFileDescriptor(fileDescriptor), cork(corked)
+{}
+
+ClassicBackend::~ClassicBackend()
+{
+    try
+    {
+        flush();
+    }
+    catch (Socket::IOError& error)
+    {
+        /* The connection is going away anyway. */
+    }
+}
+
+size_t ClassicBackend::receive(char* buffer, size_t size)
+{
+    flush();
+
+    fd_set recieveFd;
+    struct timeval timeout;
+
+    FD_ZERO(&recieveFd);
+    FD_SET(socketFileDescriptor, &recieveFd);
+
+    timeout.tv_sec = __SOCKET_READ_TIMEOUT;
+    timeout.tv_usec = 0;
+
+    /* Linux leaves the remaining time in the timeout, so a signal
+       doesn't extend the wait. */
+    int selectReturnValue;
+    do
+    {
+        selectReturnValue = select(socketFileDescriptor + 1, &recieveFd, NULL, NULL, &timeout);
+    }
+    while (selectReturnValue < 0 && errno == EINTR);
+
+    if (selectReturnValue <= 0)
+    {
+        throw Socket::IOError("Recieving error", "Server not responding (connection timed out).");
+    }
+
+    ssize_t bytesRead;
+    do
+    {
+        bytesRead = ::read(socketFileDescriptor, buffer, size);
+    }
+    while (bytesRead < 0 && errno == EINTR);
+
+    if (bytesRead < 0)
+    {
+        throw Socket::IOError("Recieving error", "Unable to resolve data from remote host");
+    }
+
+    return bytesRead;
+}
+
+void ClassicBackend::send(const char* data, size_t length)
+{
+    pendingSend.append(data, length);
+}
+
+void ClassicBackend::flush()
+{
+    if (pendingSend.empty())
+    {
+        return;
+    }
+
+    if (cork)
+    {
+        setCork(true);
+    }
+
+    size_t sent = 0;
+    while (sent < pendingSend.length())
+    {
+        ssize_t written = ::send(socketFileDescriptor, pendingSend.data() + sent,
+                                 pendingSend.length() - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            pendingSend.clear();
+            throw Socket::IOError("Sending error", "Unable to send data to remote host");
+        }
+
+        sent += written; /* Short writes continue where they stopped. */
+    }
+
+    pendingSend.clear();
+
+    if (cork)
+    {
+        setCork(false); /* Pushes out the last partial segment. */
+    }
+}
+
+void ClassicBackend::setCork(bool enabled)
+{
+    int value = enabled ? 1 : 0;
+    setsockopt(socketFileDescriptor, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+}
@@ -0,0 +1,107 @@
+/**
+ * @brief I/O backends of Socket
+ *
+ * @file socketbackend.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _SOCKETBACKEND__H
+#define _SOCKETBACKEND__H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief The way Socket moves data to and from the kernel.
+ *
+ *  Socket keeps the connection and the receive buffer, the
+ *  backend only performs the actual system calls on the
+ *  connected file descriptor. Errors are reported by throwing
+ *  Socket::IOError.
+ */
+class SocketBackend
+{
+    public:
+        enum Type
+        {
+            CLASSIC,  /*< select() + read()/write() */
+            IO_URING  /*< io_uring, see IoUringBackend */
+        };
+
+        virtual ~SocketBackend() {}
+
+        /**
+         * @brief Create a backend for a connected socket.
+         *
+         *  When the requested backend isn't available (e.g. the
+         *  kernel doesn't support io_uring), the classic one is
+         *  returned instead.
+         *
+         * @param[in] type Requested backend.
+         * @param[in] fileDescriptor Connected socket.
+         * @param[in] receiveBuffer Buffer that will be passed to receive().
+         * @param[in] receiveBufferSize Size of \c receiveBuffer.
+         * @param[in] cork Hold partial segments while flushing (TCP_CORK).
+         * @return New backend; the caller owns it.
+         */
+        static SocketBackend* create(Type type, int fileDescriptor,
+                                     char* receiveBuffer, size_t receiveBufferSize,
+                                     bool cork = false);
+
+        virtual Type getType() const = 0;
+
+        /**
+         * @brief Read available data.
+         *
+         *  Waits until some data arrive (at most __SOCKET_READ_TIMEOUT
+         *  seconds) and stores at most \c size of them to \c buffer.
+         *
+         * @return Number of bytes read, 0 when the connection was closed.
+         */
+        virtual size_t receive(char* buffer, size_t size) = 0;
+
+        /**
+         * @brief Send data.
+         *
+         *  A backend may postpone the sending until the next
+         *  receive() or flush().
+         */
+        virtual void send(const char* data, size_t length) = 0;
+
+        /**
+         * @brief Send everything postponed by send().
+         */
+        virtual void flush() {}
+};
+
+/**
+ * @brief Plain blocking system calls.
+ *
+ *  send() only appends the data to a buffer. Everything queued is
+ *  sent with a single system call before the next receive(), so a
+ *  batch of pipelined commands leaves in as few segments as possible.
+ *  With \c cork, TCP_CORK is held while the buffer is being sent, so
+ *  a buffer that takes more than one call doesn't go out in runts.
+ */
+class ClassicBackend : public SocketBackend
+{
+    int socketFileDescriptor;
+    bool cork;
+
+    std::string pendingSend; /*< Keeps its memory between flushes. */
+
+    public:
+        ClassicBackend(int fileDescriptor, bool corked = false);
+        ~ClassicBackend();
+
+        Type getType() const { return CLASSIC; }
+        size_t receive(char* buffer, size_t size);
+        void send(const char* data, size_t length);
+        void flush();
+
+    private:
+        void setCork(bool enabled);
+};
+
+#endif
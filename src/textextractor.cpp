@@ -0,0 +1,405 @@
+/**
+ * @brief Implementation of TextExtractor
+ *
+ * @file textextractor.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "textextractor.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "mimecodec.h"
+
+namespace
+{
+    bool isWordCharacter(unsigned char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+               (c >= '0' && c <= '9') || c >= 0x80;
+    }
+
+    char toLower(unsigned char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+
+    bool startsWith(std::string_view text, std::string_view prefix)
+    {
+        return text.length() >= prefix.length() &&
+               strncasecmp(text.data(), prefix.data(), prefix.length()) == 0;
+    }
+
+    std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+}
+
+TextExtractor::Part::Part()
+    : inHeader(true), isText(true), isHtml(false), encoding(PLAIN)
+{}
+
+TextExtractor::TextExtractor()
+    : isTopLevel(true), inTag(false)
+{}
+
+void TextExtractor::begin()
+{
+    part = Part();
+    isTopLevel = true;
+    boundaries.clear();
+
+    line.clear();
+    field.clear();
+    base64Carry.clear();
+    word.clear();
+    inTag = false;
+
+    terms.clear();
+}
+
+void TextExtractor::write(const char* data, size_t length)
+{
+    const char* end = data + length;
+    while (data < end)
+    {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (newline == NULL)
+        {
+            line.append(data, end - data);
+            break;
+        }
+
+        /* Whole lines are processed in place. */
+        std::string_view content;
+        if (line.empty())
+        {
+            content = std::string_view(data, newline - data);
+        }
+        else
+        {
+            line.append(data, newline - data);
+            content = line;
+        }
+
+        if (!content.empty() && content.back() == '\r')
+        {
+            content.remove_suffix(1);
+        }
+
+        processLine(content);
+        line.clear();
+
+        data = newline + 1;
+    }
+}
+
+void TextExtractor::end(std::vector<std::string>* words)
+{
+    if (!line.empty())
+    {
+        processLine(line);
+        line.clear();
+    }
+
+    if (part.inHeader)
+    {
+        processField();
+    }
+    finishWord();
+
+    words->assign(terms.begin(), terms.end());
+    terms.clear();
+}
+
+void TextExtractor::tokenize(std::string_view text, std::vector<std::string>* words)
+{
+    std::string current;
+    for (size_t i = 0; i <= text.length(); i++)
+    {
+        if (i < text.length() && isWordCharacter(text[i]))
+        {
+            current += toLower(text[i]);
+            continue;
+        }
+
+        if (current.length() >= MIN_WORD_LENGTH && current.length() <= MAX_WORD_LENGTH)
+        {
+            words->push_back(current);
+        }
+        current.clear();
+    }
+}
+
+void TextExtractor::processLine(std::string_view content)
+{
+    if (processBoundary(content))
+    {
+        return;
+    }
+
+    if (!part.inHeader)
+    {
+        processBody(content);
+        return;
+    }
+
+    if (content.empty()) /* End of the header. */
+    {
+        processField();
+        part.inHeader = false;
+
+        if (!part.boundary.empty())
+        {
+            boundaries.push_back(part.boundary);
+        }
+        return;
+    }
+
+    if (content[0] == ' ' || content[0] == '\t') /* Folded line */
+    {
+        field += ' ';
+        field.append(trim(content));
+        return;
+    }
+
+    processField();
+    field.assign(content);
+}
+
+bool TextExtractor::processBoundary(std::string_view content)
+{
+    if (boundaries.empty() || content.length() < 2 || content[0] != '-' || content[1] != '-')
+    {
+        return false;
+    }
+
+    content.remove_prefix(2);
+    for (size_t i = boundaries.size(); i-- > 0; )
+    {
+        if (content.compare(0, boundaries[i].length(), boundaries[i]) != 0)
+        {
+            continue;
+        }
+
+        finishWord();
+        base64Carry.clear();
+        inTag = false;
+        isTopLevel = false;
+
+        std::string_view rest = content.substr(boundaries[i].length());
+        if (rest.compare(0, 2, "--") == 0)
+        {
+            /* End of the multipart; skip the epilogue. */
+            boundaries.resize(i);
+            part = Part();
+            part.inHeader = false;
+            part.isText = false;
+        }
+        else
+        {
+            boundaries.resize(i + 1);
+            part = Part();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void TextExtractor::processField()
+{
+    if (field.empty())
+    {
+        return;
+    }
+
+    size_t colon = field.find(':');
+    if (colon == std::string::npos)
+    {
+        field.clear();
+        return;
+    }
+
+    std::string_view name(field.data(), colon);
+    std::string_view value = trim(std::string_view(field).substr(colon + 1));
+
+    if (startsWith(name, "content-type") && name.length() == 12)
+    {
+        part.isText = startsWith(value, "text/");
+        part.isHtml = startsWith(value, "text/html");
+
+        if (startsWith(value, "multipart/"))
+        {
+            part.boundary = MimeCodec::getParameter(std::string(value), "boundary");
+        }
+    }
+    else if (startsWith(name, "content-transfer-encoding") && name.length() == 25)
+    {
+        if (startsWith(value, "quoted-printable"))
+        {
+            part.encoding = QUOTED_PRINTABLE;
+        }
+        else if (startsWith(value, "base64"))
+        {
+            part.encoding = BASE64;
+        }
+    }
+    else if (isTopLevel)
+    {
+        static const char* const INDEXED_FIELDS[] = {"from", "to", "cc", "bcc", "subject", "reply-to"};
+
+        for (size_t i = 0; i < sizeof(INDEXED_FIELDS) / sizeof(INDEXED_FIELDS[0]); i++)
+        {
+            if (name.length() == strlen(INDEXED_FIELDS[i]) && startsWith(name, INDEXED_FIELDS[i]))
+            {
+                bool isHtml = part.isHtml;
+                part.isHtml = false;
+
+                decodeEncodedWords(value, &decoded);
+                addText(decoded);
+                finishWord();
+
+                part.isHtml = isHtml;
+                break;
+            }
+        }
+    }
+
+    field.clear();
+}
+
+void TextExtractor::processBody(std::string_view content)
+{
+    if (!part.isText)
+    {
+        return;
+    }
+
+    switch (part.encoding)
+    {
+        case PLAIN:
+            addText(content);
+            finishWord();
+            break;
+
+        case QUOTED_PRINTABLE:
+            MimeCodec::decodeQuotedPrintable(content, false, &decoded);
+            addText(decoded);
+            if (content.empty() || content.back() != '=') /* Not a soft line break */
+            {
+                finishWord();
+            }
+            break;
+
+        case BASE64:
+            MimeCodec::decodeBase64(content, &base64Carry, &decoded);
+            addText(decoded);
+            break;
+    }
+}
+
+void TextExtractor::addText(std::string_view text)
+{
+    for (size_t i = 0; i < text.length(); i++)
+    {
+        unsigned char c = text[i];
+
+        if (part.isHtml)
+        {
+            if (c == '<')
+            {
+                finishWord();
+                inTag = true;
+                continue;
+            }
+            if (inTag)
+            {
+                inTag = c != '>';
+                continue;
+            }
+        }
+
+        if (!isWordCharacter(c))
+        {
+            finishWord();
+            continue;
+        }
+
+        /* Keep one extra character to tell that it's too long. */
+        if (word.length() <= MAX_WORD_LENGTH)
+        {
+            word += toLower(c);
+        }
+    }
+}
+
+void TextExtractor::finishWord()
+{
+    if (word.length() >= MIN_WORD_LENGTH && word.length() <= MAX_WORD_LENGTH)
+    {
+        terms.insert(word);
+    }
+    word.clear();
+}
+
+void TextExtractor::decodeEncodedWords(std::string_view text, std::string* output)
+{
+    output->clear();
+
+    std::string piece;
+    std::string carry;
+    while (!text.empty())
+    {
+        /* =?charset?encoding?text?= */
+        size_t start = text.find("=?");
+        size_t encodingEnd = std::string_view::npos;
+        size_t end = std::string_view::npos;
+
+        if (start != std::string_view::npos)
+        {
+            size_t charsetEnd = text.find('?', start + 2);
+            if (charsetEnd != std::string_view::npos && charsetEnd + 2 < text.length() &&
+                text[charsetEnd + 2] == '?')
+            {
+                encodingEnd = charsetEnd + 2;
+                end = text.find("?=", encodingEnd + 1);
+            }
+        }
+
+        if (end == std::string_view::npos)
+        {
+            output->append(text);
+            break;
+        }
+
+        output->append(text.substr(0, start));
+
+        char encoding = toLower(text[encodingEnd - 1]);
+        std::string_view encoded = text.substr(encodingEnd + 1, end - encodingEnd - 1);
+        if (encoding == 'b')
+        {
+            carry.clear();
+            MimeCodec::decodeBase64(encoded, &carry, &piece);
+        }
+        else
+        {
+            MimeCodec::decodeQuotedPrintable(encoded, true, &piece);
+        }
+        output->append(piece);
+
+        text.remove_prefix(end + 2);
+    }
+}
@@ -0,0 +1,125 @@
+/**
+ * @brief Words of a message for the search index
+ *
+ * @file textextractor.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _TEXTEXTRACTOR__H
+#define _TEXTEXTRACTOR__H
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Streaming extraction of searchable words from a message.
+ *
+ *  The message is fed in as it's received and parsed line by line
+ *  with a little MIME parser. Words are taken from the addressing
+ *  headers and the subject (including RFC 2047 encoded words) and
+ *  from all the text parts, which are decoded from quoted-printable
+ *  or base64 on the fly. Tags of text/html parts are skipped, other
+ *  parts (attachments) are ignored.
+ *
+ *  A word is a run of ASCII letters and digits or of bytes >= 0x80
+ *  (so UTF-8 text keeps its words together), lower-cased. Words
+ *  shorter than MIN_WORD_LENGTH or longer than MAX_WORD_LENGTH are
+ *  dropped; the long ones are mostly encoded junk.
+ */
+class TextExtractor
+{
+    public:
+        static const size_t MIN_WORD_LENGTH = 2;
+        static const size_t MAX_WORD_LENGTH = 40;
+
+    private:
+        enum Encoding
+        {
+            PLAIN,
+            QUOTED_PRINTABLE,
+            BASE64
+        };
+
+        /**
+         * @brief State of the MIME part being parsed.
+         */
+        struct Part
+        {
+            bool inHeader;
+            bool isText;
+            bool isHtml;
+            Encoding encoding;
+            std::string boundary; /*< Set for multipart parts */
+
+            Part();
+        };
+
+        Part part;
+        bool isTopLevel;
+        std::vector<std::string> boundaries; /*< Enclosing multiparts, outermost first */
+
+        std::string line;       /*< Incomplete line from the last write() */
+        std::string field;      /*< Header field being unfolded */
+        std::string decoded;    /*< Reused decoding buffer */
+        std::string base64Carry;
+
+        std::string word;
+        bool inTag;
+
+        std::unordered_set<std::string> terms;
+
+    public:
+        TextExtractor();
+
+        /**
+         * @brief Start a new message.
+         *
+         * @return void
+         */
+        void begin();
+
+        /**
+         * @brief Feed the next chunk of the message.
+         *
+         * @param[in] data Message data with \\r\\n line endings.
+         * @param[in] length Number of bytes in \\c data.
+         * @return void
+         */
+        void write(const char* data, size_t length);
+
+        /**
+         * @brief Finish the message.
+         *
+         * @param[out] words Distinct words of the message.
+         * @return void
+         */
+        void end(std::vector<std::string>* words);
+
+        /**
+         * @brief Split a text into words.
+         *
+         *  Uses the same rules as the extraction, so it can be used
+         *  to turn a query into words.
+         *
+         * @param[in] text The text.
+         * @param[out] words Words in the order of appearance.
+         * @return void
+         */
+        static void tokenize(std::string_view text, std::vector<std::string>* words);
+
+    private:
+        void processLine(std::string_view content);
+        void processField();
+        void processBody(std::string_view content);
+        bool processBoundary(std::string_view content);
+
+        void addText(std::string_view text);
+        void finishWord();
+
+        static void decodeEncodedWords(std::string_view text, std::string* output);
+};
+
+#endif
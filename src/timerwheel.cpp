@@ -0,0 +1,123 @@
+/**
+ * @brief Implementation of TimerWheel
+ *
+ * @file timerwheel.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(uint64_t start)
+    : now(start), count(0)
+{}
+
+void TimerWheel::schedule(int key, uint64_t delay)
+{
+    Timer timer;
+    timer.key    = key;
+    timer.expiry = now + (delay > 0 ? delay : 1);
+
+    insert(timer);
+    count++;
+}
+
+void TimerWheel::insert(Timer const& timer)
+{
+    uint64_t delay = timer.expiry - now;
+
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delay >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    /* Timers beyond the span wait in the farthest slot and
+       are put back there until they get in range. */
+    uint64_t expiry = timer.expiry;
+    uint64_t span   = uint64_t(1) << (SLOT_BITS * LEVELS);
+    if (delay >= span)
+    {
+        expiry = now + span - 1;
+    }
+
+    unsigned slot = (expiry >> (SLOT_BITS * level)) & (SLOTS - 1);
+    slots[level][slot].push_back(timer);
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    unsigned slot = (now >> (SLOT_BITS * level)) & (SLOTS - 1);
+
+    std::vector<Timer> timers;
+    timers.swap(slots[level][slot]);
+
+    for (std::vector<Timer>::iterator timer = timers.begin(); timer != timers.end(); timer++)
+    {
+        insert(*timer);
+    }
+}
+
+void TimerWheel::advance(uint64_t time, std::vector<int>* expired)
+{
+    while (now < time)
+    {
+        now++;
+
+        /* Cascade every level whose lower neighbour just wrapped. */
+        for (unsigned level = 1; level < LEVELS; level++)
+        {
+            if ((now & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0)
+            {
+                break;
+            }
+            cascade(level);
+        }
+
+        std::vector<Timer>& slot = slots[0][now & (SLOTS - 1)];
+        if (slot.empty())
+        {
+            continue;
+        }
+
+        std::vector<Timer> timers;
+        timers.swap(slot);
+
+        for (std::vector<Timer>::iterator timer = timers.begin(); timer != timers.end(); timer++)
+        {
+            if (timer->expiry > now)
+            {
+                insert(*timer); /* Clamped, not due yet. */
+                continue;
+            }
+
+            expired->push_back(timer->key);
+            count--;
+        }
+    }
+}
+
+uint64_t TimerWheel::getIdleTicks() const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    /* Level 0 is exact; beyond it the next cascade is the limit. */
+    for (unsigned ticks = 1; ticks <= SLOTS; ticks++)
+    {
+        uint64_t time = now + ticks;
+        if (!slots[0][time & (SLOTS - 1)].empty())
+        {
+            return ticks;
+        }
+
+        if ((time & (SLOTS - 1)) == 0)
+        {
+            return ticks;
+        }
+    }
+
+    return SLOTS;
+}
@@ -0,0 +1,92 @@
+/**
+ * @brief Hierarchical timer wheel
+ *
+ * @file timerwheel.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _TIMERWHEEL__H
+#define _TIMERWHEEL__H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief Schedule of timers with O(1) insertion and expiry.
+ *
+ *  Time is measured in ticks. The wheel has LEVELS levels of
+ *  SLOTS slots each; level 0 holds the timers due within SLOTS
+ *  ticks, one slot per tick, and every next level covers SLOTS
+ *  times longer period with a coarser slot. Whenever a level wraps
+ *  around, one slot of the level above is cascaded (its timers are
+ *  spread over the lower levels), so a timer is touched at most
+ *  LEVELS times no matter how many timers are scheduled.
+ *
+ *  Timers are identified by an integer key chosen by the caller.
+ *  Delays longer than the span of the wheel are clamped to it.
+ */
+class TimerWheel
+{
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS     = 1 << SLOT_BITS;
+    static const unsigned LEVELS    = 4;
+
+    struct Timer
+    {
+        int key;
+        uint64_t expiry;
+    };
+
+    std::vector<Timer> slots[LEVELS][SLOTS];
+    uint64_t now;
+    size_t count;
+
+    public:
+        /**
+         * @param[in] start Current time in ticks.
+         */
+        TimerWheel(uint64_t start = 0);
+
+        /**
+         * @brief Add a timer.
+         *
+         * @param[in] key Identification of the timer.
+         * @param[in] delay Ticks from now, at least 1.
+         * @return void
+         */
+        void schedule(int key, uint64_t delay);
+
+        /**
+         * @brief Move the time forward.
+         *
+         *  Keys of the timers that expired on the way are appended to
+         *  \c expired in the order of their expiry.
+         *
+         * @param[in] time New current time; it never goes back.
+         * @param[out] expired Keys of the expired timers.
+         * @return void
+         */
+        void advance(uint64_t time, std::vector<int>* expired);
+
+        /**
+         * @brief How long it's safe to wait.
+         *
+         *  Nothing expires before the returned number of ticks passes.
+         *  It may be less than the actual delay of the next timer
+         *  (when that one sits in a higher level), but never more.
+         *
+         * @return Ticks until the next timer may expire, 0 when empty.
+         */
+        uint64_t getIdleTicks() const;
+
+        uint64_t getTime() const { return now; }
+        size_t size() const { return count; }
+
+    private:
+        void insert(Timer const& timer);
+        void cascade(unsigned level);
+};
+
+#endif
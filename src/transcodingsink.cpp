@@ -0,0 +1,646 @@
+/**
+ * @brief Implementation of TranscodingSink
+ *
+ * @file transcodingsink.cpp
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#include "transcodingsink.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "mimecodec.h"
+
+namespace
+{
+    /* Longest UTF-8 text in one encoded word, keeps it within 75 characters. */
+    const size_t ENCODED_WORD_BYTES = 45;
+
+    /* Longest quoted-printable line without the soft line break. */
+    const size_t QUOTED_PRINTABLE_LINE = 75;
+
+    const size_t BASE64_LINE = 76;
+
+    bool startsWith(std::string_view text, std::string_view prefix)
+    {
+        return text.length() >= prefix.length() &&
+               strncasecmp(text.data(), prefix.data(), prefix.length()) == 0;
+    }
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    /* End of the field starting at start, including its folded lines. */
+    size_t getFieldEnd(std::string_view header, size_t start)
+    {
+        size_t end = start;
+        do
+        {
+            size_t newline = header.find('\n', end);
+            end = newline == std::string_view::npos ? header.length() : newline + 1;
+        }
+        while (end < header.length() && end > start + 2 &&
+               (header[end] == ' ' || header[end] == '\t'));
+
+        return end;
+    }
+
+    /* Name of a field, empty for the line ending the header. */
+    std::string_view getFieldName(std::string_view field)
+    {
+        size_t colon = field.find(':');
+        return colon == std::string_view::npos ? std::string_view() : field.substr(0, colon);
+    }
+
+    /* Unfolded value of a field. */
+    std::string getFieldValue(std::string_view field)
+    {
+        std::string value;
+        for (size_t i = field.find(':') + 1; i < field.length(); i++)
+        {
+            if (field[i] != '\r' && field[i] != '\n')
+            {
+                value += field[i];
+            }
+        }
+
+        size_t start = value.find_first_not_of(" \t");
+        return start == std::string::npos ? std::string() : value.substr(start);
+    }
+
+    bool isField(std::string_view name, std::string_view expected)
+    {
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\t'))
+        {
+            name.remove_suffix(1);
+        }
+        return name.length() == expected.length() && startsWith(name, expected);
+    }
+
+    /* Range of the value of a parameter (e.g. charset=...) in a raw field. */
+    bool findParameter(std::string_view field, std::string_view name, size_t* start, size_t* end)
+    {
+        for (size_t position = field.find(';'); position != std::string_view::npos;
+             position = field.find(';', position + 1))
+        {
+            size_t i = position + 1;
+            while (i < field.length() && isSpace(field[i]))
+            {
+                i++;
+            }
+
+            if (!startsWith(field.substr(i), name))
+            {
+                continue;
+            }
+            i += name.length();
+
+            while (i < field.length() && isSpace(field[i]))
+            {
+                i++;
+            }
+            if (i == field.length() || field[i] != '=')
+            {
+                continue;
+            }
+            i++;
+
+            while (i < field.length() && isSpace(field[i]))
+            {
+                i++;
+            }
+
+            *start = i;
+            if (i < field.length() && field[i] == '"')
+            {
+                size_t quote = field.find('"', i + 1);
+                *end = quote == std::string_view::npos ? field.length() : quote + 1;
+            }
+            else
+            {
+                while (i < field.length() && field[i] != ';' && !isSpace(field[i]))
+                {
+                    i++;
+                }
+                *end = i;
+            }
+            return true;
+        }
+
+        return false;
+    }
+}
+
+TranscodingSink::Part::Part()
+    : inHeader(true), isConverted(false), encoding(PLAIN)
+{}
+
+TranscodingSink::TranscodingSink(MessageSink* target)
+    : sink(target), column(0)
+{}
+
+void TranscodingSink::begin(MessageInfo const& message)
+{
+    part = Part();
+    boundaries.clear();
+
+    line.clear();
+    header.clear();
+    output.clear();
+    base64Carry.clear();
+    bytesCarry.clear();
+    column = 0;
+
+    MessageInfo unknownSize(message.id);
+    unknownSize.uid = message.uid;
+    sink->begin(unknownSize);
+}
+
+void TranscodingSink::write(const char* data, size_t length)
+{
+    const char* end = data + length;
+    while (data < end)
+    {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (newline == NULL)
+        {
+            line.append(data, end - data);
+            break;
+        }
+
+        /* Whole lines are processed in place. */
+        if (line.empty())
+        {
+            processLine(std::string_view(data, newline + 1 - data));
+        }
+        else
+        {
+            line.append(data, newline + 1 - data);
+            processLine(line);
+            line.clear();
+        }
+
+        data = newline + 1;
+    }
+
+    if (!output.empty())
+    {
+        sink->write(output.data(), output.length());
+        output.clear();
+    }
+}
+
+void TranscodingSink::end()
+{
+    if (!line.empty())
+    {
+        processLine(line);
+        line.clear();
+    }
+    finishPart();
+
+    if (!output.empty())
+    {
+        sink->write(output.data(), output.length());
+        output.clear();
+    }
+
+    sink->end();
+}
+
+void TranscodingSink::processLine(std::string_view raw)
+{
+    std::string_view content = raw;
+    if (!content.empty() && content.back() == '\n')
+    {
+        content.remove_suffix(1);
+    }
+    if (!content.empty() && content.back() == '\r')
+    {
+        content.remove_suffix(1);
+    }
+
+    if (processBoundary(raw, content))
+    {
+        return;
+    }
+
+    if (!part.inHeader)
+    {
+        processBody(raw, content);
+        return;
+    }
+
+    header.append(raw);
+    if (content.empty()) /* End of the header. */
+    {
+        processHeader();
+        part.inHeader = false;
+
+        if (!part.boundary.empty())
+        {
+            boundaries.push_back(part.boundary);
+        }
+    }
+}
+
+bool TranscodingSink::processBoundary(std::string_view raw, std::string_view content)
+{
+    if (boundaries.empty() || content.length() < 2 || content[0] != '-' || content[1] != '-')
+    {
+        return false;
+    }
+
+    content.remove_prefix(2);
+    for (size_t i = boundaries.size(); i-- > 0; )
+    {
+        if (content.compare(0, boundaries[i].length(), boundaries[i]) != 0)
+        {
+            continue;
+        }
+
+        finishPart();
+        output.append(raw);
+
+        std::string_view rest = content.substr(boundaries[i].length());
+        if (rest.compare(0, 2, "--") == 0)
+        {
+            /* End of the multipart; the epilogue passes as it is. */
+            boundaries.resize(i);
+            part = Part();
+            part.inHeader = false;
+        }
+        else
+        {
+            boundaries.resize(i + 1);
+            part = Part();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void TranscodingSink::processHeader()
+{
+    /* Content-Type and Content-Transfer-Encoding may come
+       in any order, so the header is gone through twice. */
+    std::string contentType;
+    std::string transferEncoding;
+    bool hasEncodingField = false;
+
+    for (size_t start = 0; start < header.length(); )
+    {
+        size_t end = getFieldEnd(header, start);
+        std::string_view field(header.data() + start, end - start);
+        std::string_view name = getFieldName(field);
+        start = end;
+
+        if (isField(name, "content-type"))
+        {
+            contentType = getFieldValue(field);
+        }
+        else if (isField(name, "content-transfer-encoding"))
+        {
+            transferEncoding = getFieldValue(field);
+            hasEncodingField = true;
+        }
+    }
+
+    part.encoding = PLAIN;
+    if (startsWith(transferEncoding, "quoted-printable"))
+    {
+        part.encoding = QUOTED_PRINTABLE;
+    }
+    else if (startsWith(transferEncoding, "base64"))
+    {
+        part.encoding = BASE64;
+    }
+
+    if (startsWith(contentType, "multipart/"))
+    {
+        part.boundary = MimeCodec::getParameter(contentType, "boundary");
+    }
+
+    /* Encoded UTF-8 is left alone, re-encoding it would only
+       change the line breaks. */
+    std::string charset = MimeCodec::getParameter(contentType, "charset");
+    bool isUtf8 = CharsetConverter::isUtf8(charset);
+
+    part.isConverted = startsWith(contentType, "text/") && !charset.empty() &&
+                       !CharsetConverter::isAscii(charset) &&
+                       (part.encoding == PLAIN || !isUtf8) &&
+                       converter.setCharset(charset);
+
+    bool isRelabeled = part.isConverted && !isUtf8;
+
+    for (size_t start = 0; start < header.length(); )
+    {
+        size_t end = getFieldEnd(header, start);
+        std::string_view field(header.data() + start, end - start);
+        std::string_view name = getFieldName(field);
+        start = end;
+
+        if (name.empty() && field.find_first_not_of("\r\n") == std::string_view::npos &&
+            isRelabeled && part.encoding == PLAIN && !hasEncodingField)
+        {
+            output.append("Content-Transfer-Encoding: 8bit\r\n");
+        }
+
+        emitField(field, isRelabeled && isField(name, "content-type"),
+                  isRelabeled && part.encoding == PLAIN && isField(name, "content-transfer-encoding"));
+    }
+
+    header.clear();
+    base64Carry.clear();
+    bytesCarry.clear();
+    column = 0;
+}
+
+void TranscodingSink::processBody(std::string_view raw, std::string_view content)
+{
+    if (!part.isConverted)
+    {
+        output.append(raw);
+        return;
+    }
+
+    switch (part.encoding)
+    {
+        case PLAIN:
+            converter.convert(raw.data(), raw.length(), &output);
+            break;
+
+        case QUOTED_PRINTABLE:
+        {
+            bool isSoftBreak = !content.empty() && content.back() == '=';
+            bool hasLineEnd  = raw.length() > content.length();
+
+            MimeCodec::decodeQuotedPrintable(content, false, &decoded);
+            converted.clear();
+            converter.convert(decoded.data(), decoded.length(), &converted);
+            encodeQuotedPrintable(converted, hasLineEnd && !isSoftBreak);
+            break;
+        }
+
+        case BASE64:
+            MimeCodec::decodeBase64(content, &base64Carry, &decoded);
+            converted.clear();
+            converter.convert(decoded.data(), decoded.length(), &converted);
+            encodeBase64(converted);
+            break;
+    }
+}
+
+void TranscodingSink::finishPart()
+{
+    if (part.inHeader)
+    {
+        processHeader();
+        return;
+    }
+
+    if (!part.isConverted)
+    {
+        return;
+    }
+
+    converted.clear();
+    converter.finish(&converted);
+
+    switch (part.encoding)
+    {
+        case PLAIN:
+            output.append(converted);
+            break;
+
+        case QUOTED_PRINTABLE:
+            encodeQuotedPrintable(converted, false);
+            if (column > 0) /* The part ended with a soft line break. */
+            {
+                output.append("=\r\n");
+                column = 0;
+            }
+            break;
+
+        case BASE64:
+            encodeBase64(converted);
+            finishBase64();
+            break;
+    }
+
+    part.isConverted = false;
+}
+
+void TranscodingSink::emitField(std::string_view field, bool isContentType, bool isEncoding)
+{
+    size_t start = 0;
+    size_t end = 0;
+    const char* replacement = NULL;
+
+    if (isContentType && findParameter(field, "charset", &start, &end))
+    {
+        replacement = "utf-8";
+    }
+    else if (isEncoding)
+    {
+        start = field.find(':') + 1;
+        while (start < field.length() && isSpace(field[start]))
+        {
+            start++;
+        }
+        end = start;
+        while (end < field.length() && !isSpace(field[end]) && field[end] != ';')
+        {
+            end++;
+        }
+        replacement = "8bit";
+    }
+
+    if (replacement == NULL)
+    {
+        convertEncodedWords(field);
+        return;
+    }
+
+    convertEncodedWords(field.substr(0, start));
+    output.append(replacement);
+    convertEncodedWords(field.substr(end));
+}
+
+void TranscodingSink::convertEncodedWords(std::string_view text)
+{
+    while (!text.empty())
+    {
+        /* =?charset?encoding?text?= */
+        size_t start = text.find("=?");
+        if (start == std::string_view::npos)
+        {
+            break;
+        }
+
+        size_t charsetEnd = text.find('?', start + 2);
+        size_t end = std::string_view::npos;
+        if (charsetEnd != std::string_view::npos && charsetEnd + 2 < text.length() &&
+            text[charsetEnd + 2] == '?')
+        {
+            end = text.find("?=", charsetEnd + 3);
+        }
+
+        std::string_view charset;
+        std::string_view encodedText;
+        if (end != std::string_view::npos)
+        {
+            charset = text.substr(start + 2, charsetEnd - start - 2);
+            charset = charset.substr(0, charset.find('*')); /* RFC 2231 language */
+            encodedText = text.substr(charsetEnd + 3, end - charsetEnd - 3);
+        }
+
+        char encoding = end != std::string_view::npos ? text[charsetEnd + 1] | 0x20 : 0;
+        bool isWord = (encoding == 'b' || encoding == 'q') &&
+                      encodedText.find_first_of(" \t\r\n") == std::string_view::npos;
+
+        if (!isWord || CharsetConverter::isUtf8(charset) || CharsetConverter::isAscii(charset) ||
+            !wordConverter.setCharset(charset))
+        {
+            output.append(text.substr(0, start + 2));
+            text.remove_prefix(start + 2);
+            continue;
+        }
+
+        output.append(text.substr(0, start));
+
+        if (encoding == 'b')
+        {
+            std::string carry;
+            MimeCodec::decodeBase64(encodedText, &carry, &decoded);
+        }
+        else
+        {
+            MimeCodec::decodeQuotedPrintable(encodedText, true, &decoded);
+        }
+
+        converted.clear();
+        wordConverter.convert(decoded.data(), decoded.length(), &converted);
+        wordConverter.finish(&converted);
+
+        /* Split at characters; adjacent words are joined by the readers. */
+        std::string_view utf8 = converted;
+        while (!utf8.empty())
+        {
+            size_t length = std::min(utf8.length(), ENCODED_WORD_BYTES);
+            while (length < utf8.length() && (utf8[length] & 0xc0) == 0x80)
+            {
+                length--;
+            }
+
+            output.append(utf8.length() < converted.length() ? " =?UTF-8?B?" : "=?UTF-8?B?");
+            MimeCodec::encodeBase64(utf8.substr(0, length), &output);
+            output.append("?=");
+            utf8.remove_prefix(length);
+        }
+
+        text.remove_prefix(end + 2);
+    }
+
+    output.append(text);
+}
+
+void TranscodingSink::encodeQuotedPrintable(std::string_view data, bool isLineEnd)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+
+    for (size_t i = 0; i < data.length(); i++)
+    {
+        unsigned char c = data[i];
+
+        /* Spaces at the end of a line would be lost. */
+        bool isLiteral = (c >= 33 && c <= 126 && c != '=') ||
+                         ((c == ' ' || c == '\t') && !(isLineEnd && i + 1 == data.length()));
+        size_t width = isLiteral ? 1 : 3;
+
+        if (column + width > QUOTED_PRINTABLE_LINE)
+        {
+            output.append("=\r\n");
+            column = 0;
+        }
+
+        if (isLiteral)
+        {
+            output += c;
+        }
+        else
+        {
+            output += '=';
+            output += HEX[c >> 4];
+            output += HEX[c & 0xf];
+        }
+        column += width;
+    }
+
+    if (isLineEnd)
+    {
+        output.append("\r\n");
+        column = 0;
+    }
+}
+
+void TranscodingSink::encodeBase64(std::string_view data)
+{
+    encoded.clear();
+
+    if (!bytesCarry.empty())
+    {
+        size_t taken = std::min(3 - bytesCarry.length(), data.length());
+        bytesCarry.append(data.substr(0, taken));
+        data.remove_prefix(taken);
+
+        if (bytesCarry.length() < 3)
+        {
+            return;
+        }
+
+        MimeCodec::encodeBase64(bytesCarry, &encoded);
+        bytesCarry.clear();
+    }
+
+    size_t whole = data.length() / 3 * 3;
+    MimeCodec::encodeBase64(data.substr(0, whole), &encoded);
+    bytesCarry.assign(data.substr(whole));
+
+    for (size_t i = 0; i < encoded.length(); )
+    {
+        size_t length = std::min(BASE64_LINE - column, encoded.length() - i);
+        output.append(encoded, i, length);
+        column += length;
+        i += length;
+
+        if (column == BASE64_LINE)
+        {
+            output.append("\r\n");
+            column = 0;
+        }
+    }
+}
+
+void TranscodingSink::finishBase64()
+{
+    /* The last group, with padding. */
+    encoded.clear();
+    MimeCodec::encodeBase64(bytesCarry, &encoded);
+    bytesCarry.clear();
+
+    output.append(encoded);
+    column += encoded.length();
+
+    if (column > 0)
+    {
+        output.append("\r\n");
+        column = 0;
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * @brief Conversion of messages to UTF-8 on the fly
+ *
+ * @file transcodingsink.h
+ * @author Radek Pazdera (radek.pazdera@gmail.com)
+ *
+ */
+
+#ifndef _TRANSCODINGSINK__H
+#define _TRANSCODINGSINK__H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "charsetconverter.h"
+#include "messagesink.h"
+
+/**
+ * @brief Passes messages on with their text converted to UTF-8.
+ *
+ *  The message is parsed line by line as it streams through, with
+ *  a little MIME parser like the one of TextExtractor; only the
+ *  header of the current part is held. Text parts in a charset
+ *  CharsetConverter supports are converted and their charset
+ *  parameter is changed to utf-8:
+ *
+ *    - 7bit and 8bit parts are converted as they are, and marked
+ *      8bit,
+ *    - quoted-printable parts are decoded, converted and encoded
+ *      again, with the line breaks kept,
+ *    - base64 parts are decoded, converted and encoded again.
+ *
+ *  8bit parts declared as UTF-8 are validated. RFC 2047 encoded
+ *  words in the headers are converted to "=?UTF-8?B?...?=". All
+ *  the other parts, US-ASCII text included, pass unchanged.
+ *
+ *  The size of a converted message differs from the one reported
+ *  by the server, so the sink is told the size is unknown.
+ */
+class TranscodingSink : public MessageSink
+{
+    enum Encoding
+    {
+        PLAIN,
+        QUOTED_PRINTABLE,
+        BASE64
+    };
+
+    /**
+     * @brief State of the MIME part being parsed.
+     */
+    struct Part
+    {
+        bool inHeader;
+        bool isConverted;
+        Encoding encoding;
+        std::string boundary; /*< Set for multipart parts */
+
+        Part();
+    };
+
+    MessageSink* sink;
+
+    Part part;
+    std::vector<std::string> boundaries; /*< Enclosing multiparts, outermost first */
+    CharsetConverter converter;
+    CharsetConverter wordConverter;      /*< For the encoded words */
+
+    std::string line;        /*< Incomplete line from the last write() */
+    std::string header;      /*< Header of the part, as received */
+    std::string output;      /*< What goes to the sink at the end of write() */
+
+    std::string decoded;     /*< Reused buffers */
+    std::string converted;
+    std::string encoded;
+    std::string base64Carry; /*< Base64 characters of an incomplete group */
+    std::string bytesCarry;  /*< Converted bytes of an incomplete base64 group */
+    size_t column;           /*< Length of the encoded line so far */
+
+    public:
+        /**
+         * @param[in] target Where to put the converted messages.
+         */
+        TranscodingSink(MessageSink* target);
+
+        void begin(MessageInfo const& message);
+        void write(const char* data, size_t length);
+        void end();
+        void commit() { sink->commit(); }
+
+    private:
+        void processLine(std::string_view raw);
+        bool processBoundary(std::string_view raw, std::string_view content);
+        void processHeader();
+        void processBody(std::string_view raw, std::string_view content);
+        void finishPart();
+
+        void emitField(std::string_view field, bool isContentType, bool isEncoding);
+        void convertEncodedWords(std::string_view text);
+
+        void encodeQuotedPrintable(std::string_view data, bool isLineEnd);
+        void encodeBase64(std::string_view data);
+        void finishBase64();
+};
+
+#endif